@@ -8,6 +8,8 @@ export namespace lumina
 	template <typename T, typename tag>
 	struct StronglyTyped
 	{
+		using value_type = T;
+
 		StronglyTyped() = default;
 
 		explicit constexpr StronglyTyped(const T& value) noexcept(std::is_nothrow_copy_constructible<T>::value) : storage(value) {}
@@ -39,6 +41,41 @@ export namespace lumina
 
 	template <typename T>
 	using Handle64 = StronglyTyped<uint64_t, handle_tag<T>>;
+
+	template <typename T>
+	struct generational_handle_tag;
+
+	// slot index in the low bits and the generation of the slot it was allocated from in the high bits
+	template <typename T>
+	using GenerationalHandle = StronglyTyped<uint32_t, generational_handle_tag<T>>;
+
+	template <typename T>
+	using GenerationalHandle64 = StronglyTyped<uint64_t, generational_handle_tag<T>>;
+
+	template <typename S>
+	struct generation_layout
+	{
+		static_assert(std::is_same_v<S, uint32_t> || std::is_same_v<S, uint64_t>);
+
+		constexpr static uint32_t index_bits = sizeof(S) == 4 ? 24u : 32u;
+		constexpr static S index_mask = (S{1} << index_bits) - 1u;
+		constexpr static uint32_t generation_mask = static_cast<uint32_t>(~S{0} >> index_bits);
+
+		constexpr static S pack(uint32_t index, uint32_t generation) noexcept
+		{
+			return static_cast<S>(index) | (static_cast<S>(generation & generation_mask) << index_bits);
+		}
+
+		constexpr static uint32_t index(S handle) noexcept
+		{
+			return static_cast<uint32_t>(handle & index_mask);
+		}
+
+		constexpr static uint32_t generation(S handle) noexcept
+		{
+			return static_cast<uint32_t>(handle >> index_bits);
+		}
+	};
 }
 
 export template <typename T, typename tag>
@@ -1,38 +1,55 @@
+module;
+
+#include <cassert>
+
 export module lumina.core.job;
 
 import lumina.core.log;
 import std;
 
-using std::size_t, std::uint32_t, std::uint64_t;
+using std::size_t, std::uint32_t, std::uint64_t, std::int64_t;
 
 
 namespace lumina::job
 {
 
-#if defined(__clang__) || defined(__GNUC__) || defined(__GNUG__)
+constexpr size_t cache_line_size = 64;
 
-constexpr std::int64_t cache_line_size = 64;
-constexpr std::int64_t job_padding_size = cache_line_size - std::int64_t(sizeof(std::function<void()>) + sizeof(void*) + sizeof(uint32_t) + sizeof(bool)); 
-
-export struct __attribute__((packed)) job_t
+// one job per cache line, the callable is constructed in place so scheduling never touches the heap
+// generation is odd while the job is in flight and advances to even once it finishes, slots are only reused when even
+export struct alignas(cache_line_size) job_t
 {
-	std::function<void()> func{};
+	constexpr static size_t storage_align = alignof(void*);
+	constexpr static size_t storage_size = (cache_line_size - 2 * sizeof(void*) - 2 * sizeof(uint32_t)) & ~(storage_align - 1);
+
+	alignas(storage_align) std::byte storage[storage_size];
+	void (*invoke)(void*){nullptr};
 	job_t* parent{nullptr};
 	std::atomic<uint32_t> jobs_running{0u};
-	std::atomic<bool> finished{true};
-	std::byte padding[job_padding_size];
+	std::atomic<uint32_t> generation{0u};
 };
-#elif defined(_MSC_VER)
-#pragma pack(push, 1)
-export struct job_t
+static_assert(sizeof(job_t) == cache_line_size, "job_t must occupy exactly one cache line");
+
+// refers to one particular run of a job slot, stays valid (and reports finished) after the slot has been recycled
+export struct job_handle
 {
-	std::function<void()> func{};
-	job_t* parent{nullptr};
-	std::atomic<uint32_t> jobs_running{0u};
-	std::atomic<bool> finished{true};
+	job_t* job{nullptr};
+	uint32_t generation{0u};
+
+	[[nodiscard]] bool is_finished() const noexcept
+	{
+		return job->generation.load(std::memory_order_acquire) != generation;
+	}
+};
+
+// frame-critical jobs are always drained first, background jobs are meant for streaming and other blocking work
+export enum class Priority : uint32_t
+{
+	Critical,
+	Normal,
+	Background
 };
-#pragma pack(pop)
-#endif
+constexpr size_t priority_count = 3;
 
 static thread_local uint32_t current_thread_id = ~0u;
 
@@ -41,217 +58,1473 @@ export uint32_t get_thread_id()
 	return current_thread_id;
 }
 
-constexpr size_t max_concurrent_jobs = 16384;
-static thread_local job_t* g_jobAllocator;
-static thread_local uint64_t g_allocCounter = 0u;
+void count_heap_allocation();
 
-job_t* allocate_job()
+// Chase-Lev deque, the owning thread pushes and pops at the bottom (LIFO), other threads steal from the top (FIFO).
+// Only the owner grows the ring, replaced rings stay alive until shutdown since thieves may still be reading them.
+class WorkStealingQueue
 {
-	job_t* j = &g_jobAllocator[g_allocCounter & (max_concurrent_jobs - 1zu)];
+	struct Ring
+	{
+		int64_t mask;
+		std::unique_ptr<std::atomic<job_t*>[]> slots;
+	};
+public:
+	constexpr static size_t initial_capacity = 16384;
 
-	++g_allocCounter;
-	return j;
-}
+	WorkStealingQueue()
+	{
+		rings.push_back({static_cast<int64_t>(initial_capacity) - 1, std::make_unique<std::atomic<job_t*>[]>(initial_capacity)});
+		ring.store(&rings.back(), std::memory_order_relaxed);
+	}
+
+	WorkStealingQueue(const WorkStealingQueue&) = delete;
+	WorkStealingQueue& operator=(const WorkStealingQueue&) = delete;
+
+	void push(job_t* j) noexcept
+	{
+		const int64_t b = bottom.load(std::memory_order_relaxed);
+		const int64_t t = top.load(std::memory_order_acquire);
+		Ring* r = ring.load(std::memory_order_relaxed);
+
+		if(b - t > r->mask) [[unlikely]]
+			r = grow(r, t, b);
+
+		r->slots[b & r->mask].store(j, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		bottom.store(b + 1, std::memory_order_relaxed);
+	}
+
+	job_t* pop() noexcept
+	{
+		const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+		Ring* r = ring.load(std::memory_order_relaxed);
+		bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t = top.load(std::memory_order_relaxed);
+
+		if(t > b)
+		{
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		job_t* j = r->slots[b & r->mask].load(std::memory_order_relaxed);
+		if(t == b)
+		{
+			// last entry, race against thieves for it
+			if(!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				j = nullptr;
+
+			bottom.store(b + 1, std::memory_order_relaxed);
+		}
+
+		return j;
+	}
+
+	job_t* steal() noexcept
+	{
+		for(;;)
+		{
+			int64_t t = top.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			const int64_t b = bottom.load(std::memory_order_acquire);
+
+			if(t >= b)
+				return nullptr;
+
+			Ring* r = ring.load(std::memory_order_acquire);
+			job_t* j = r->slots[t & r->mask].load(std::memory_order_relaxed);
+			if(top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				return j;
+		}
+	}
+
+	// racy snapshot, only used to decide whether a wake-up is worth sending
+	[[nodiscard]] bool empty() const noexcept
+	{
+		return top.load(std::memory_order_acquire) >= bottom.load(std::memory_order_acquire);
+	}
+private:
+	Ring* grow(Ring* old, int64_t t, int64_t b)
+	{
+		const int64_t capacity = 2 * (old->mask + 1);
+		rings.push_back({capacity - 1, std::make_unique<std::atomic<job_t*>[]>(static_cast<size_t>(capacity))});
+		count_heap_allocation();
+
+		Ring* r = &rings.back();
+		for(int64_t i = t; i < b; i++)
+			r->slots[i & r->mask].store(old->slots[i & old->mask].load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+		ring.store(r, std::memory_order_release);
+		return r;
+	}
+
+	alignas(cache_line_size) std::atomic<int64_t> top{0};
+	alignas(cache_line_size) std::atomic<int64_t> bottom{0};
+	std::atomic<Ring*> ring{nullptr};
+	std::deque<Ring> rings;
+};
+
+// per-thread ring of job slots, a slot that is still in flight when the ring wraps around makes the ring grow instead of being overwritten
+// replaced rings are kept until shutdown because their jobs may still be queued or waited on
+constexpr size_t initial_job_ring_size = 16384;
+
+struct JobRing
+{
+	std::unique_ptr<job_t[]> slots;
+	uint64_t mask{0u};
+	uint64_t counter{0u};
+	std::vector<std::unique_ptr<job_t[]>> retired;
+};
+
+// jobs scheduled from threads the job system does not own, job threads check it after their own deques
+constexpr size_t injected_job_ring_size = 1024;
+
+struct InjectionQueue
+{
+	std::mutex lock;
+	std::array<std::deque<job_t*>, priority_count> jobs;
+	// slots for injected jobs, guarded by lock
+	JobRing ring;
+	alignas(cache_line_size) std::atomic<uint32_t> queued{0u};
+};
 
 struct ThreadInfo
 {
 	std::thread thread;
 	std::string name;
 
-	std::condition_variable work_available;
-	std::condition_variable work_done;
-
-	size_t jobs_running{0u};
 	job_t* active_job{nullptr};
+	std::array<WorkStealingQueue, priority_count> jobs;
 
-	std::mutex jobs_mutex;
-	std::queue<job_t*> jobs;
+	// written by the owning thread only, read by get_stats
+	std::atomic<uint64_t> jobs_scheduled{0u};
+	std::atomic<uint64_t> heap_allocations{0u};
+};
+
+// compute threads and dedicated I/O threads park separately so a background job never wakes a thread that cannot run it
+struct WakeLane
+{
+	alignas(cache_line_size) std::atomic<uint32_t> signal{0u};
+	std::atomic<uint32_t> sleeping{0u};
 };
 
 struct JobSystemContext
 {
-	std::atomic<bool> waiting{false};
 	std::atomic<bool> running{false};
 
-	std::condition_variable work_available;
-	std::condition_variable work_done;
+	// number of scheduled jobs that have not finished yet
+	alignas(cache_line_size) std::atomic<uint32_t> jobs_pending{0u};
+
+	// idle threads park on their lane signal, producers only bump it when someone is sleeping
+	std::array<WakeLane, 2> lanes;
+	// threads parked inside wait() also need a wake-up when a job finishes
+	alignas(cache_line_size) std::atomic<uint32_t> helpers{0u};
 
-	size_t jobs_running{0u};
-	std::mutex jobs_mutex;
-	std::queue<job_t*> jobs;
+	// without I/O threads at most max_background_workers compute threads run background jobs at once
+	alignas(cache_line_size) std::atomic<uint32_t> background_running{0u};
+	uint32_t max_background_workers{1u};
+	// compute workers currently blocked in a wait, those only pick up background jobs once all workers are
+	std::atomic<uint32_t> waiting_workers{0u};
 
+	// threads[0] is the thread that called init, compute workers use 1..num_threads, I/O threads come after them
 	uint32_t num_threads{0u};
+	uint32_t num_io_threads{0u};
 	std::unique_ptr<ThreadInfo[]> threads{nullptr};
+
+	InjectionQueue injected;
+
+	[[nodiscard]] uint32_t total_threads() const noexcept
+	{
+		return num_threads + num_io_threads + 1;
+	}
+
+	[[nodiscard]] bool is_job_thread(uint32_t id) const noexcept
+	{
+		return id < total_threads();
+	}
+
+	[[nodiscard]] bool is_io_thread(uint32_t id) const noexcept
+	{
+		return id > num_threads;
+	}
+
+	[[nodiscard]] bool is_compute_worker(uint32_t id) const noexcept
+	{
+		return id != 0 && id <= num_threads;
+	}
+
+	[[nodiscard]] WakeLane& lane_of(uint32_t id) noexcept
+	{
+		return lanes[is_io_thread(id)];
+	}
 };
 JobSystemContext* ctx;
 
-void worker(uint32_t id)
+void count_heap_allocation()
 {
-	job_t* j;
+	if(ctx && current_thread_id < ctx->total_threads())
+		ctx->threads[current_thread_id].heap_allocations.fetch_add(1u, std::memory_order_relaxed);
+}
 
-	current_thread_id = id + 1;
+static thread_local JobRing g_jobRing;
+
+void grow_job_ring(JobRing& ring)
+{
+	const uint64_t size = 2 * (ring.mask + 1);
+	log::warn("job_system: thread {} has more than {} jobs in flight, growing job ring", current_thread_id, ring.mask + 1);
 
-	auto& this_thread = ctx->threads[id];
-	g_jobAllocator = new job_t[max_concurrent_jobs];
+	ring.retired.push_back(std::move(ring.slots));
+	ring.slots = std::make_unique<job_t[]>(size);
+	ring.mask = size - 1;
+	ring.counter = 0u;
+	count_heap_allocation();
+}
 
-	for(;;)
+job_t* allocate_job(JobRing& ring)
+{
+	job_t* j = &ring.slots[ring.counter & ring.mask];
+	if(j->generation.load(std::memory_order_acquire) & 1u) [[unlikely]]
 	{
-		std::unique_lock<std::mutex> lock{ctx->jobs_mutex};
-		ctx->work_available.wait(lock, []
-		{
-			return !ctx->jobs.empty() || !ctx->running;
-		});
+		grow_job_ring(ring);
+		j = &ring.slots[0];
+	}
 
-		if(!ctx->running)
-			break;
+	++ring.counter;
+	return j;
+}
 
-		j = ctx->jobs.front();
-		ctx->jobs.pop();
+// per-thread LIFO scratch memory for temporaries of parallel algorithms, nested calls on one thread release in reverse order
+constexpr size_t scratch_size = 64 * 1024;
+static thread_local std::byte* g_scratch = nullptr;
+static thread_local size_t g_scratchTop = 0u;
 
-		++ctx->jobs_running;
-		if(!this_thread.active_job)
-			this_thread.active_job = j;
+void init_thread_storage()
+{
+	g_jobRing.slots = std::make_unique<job_t[]>(initial_job_ring_size);
+	g_jobRing.mask = initial_job_ring_size - 1;
+	g_jobRing.counter = 0u;
+	g_scratch = new std::byte[scratch_size];
+	g_scratchTop = 0u;
 
-		lock.unlock();
-		j->func();
-		lock.lock();
+	// job ring, scratch and the deques allocated with ThreadInfo
+	ctx->threads[current_thread_id].heap_allocations.fetch_add(2u + priority_count, std::memory_order_relaxed);
+}
 
-		--j->jobs_running;
+void destroy_thread_storage()
+{
+	g_jobRing.slots.reset();
+	g_jobRing.retired.clear();
+	delete[] g_scratch;
+	g_scratch = nullptr;
+}
 
-		if(!j->jobs_running)
+template <typename T>
+class ScratchArray
+{
+public:
+	ScratchArray(size_t n, const T& value) : count{n}
+	{
+		const size_t offset = (g_scratchTop + alignof(T) - 1) & ~(alignof(T) - 1);
+		if(g_scratch && offset + n * sizeof(T) <= scratch_size)
 		{
-			j->finished = true;
-			std::atomic_notify_all(&j->finished);
+			items = reinterpret_cast<T*>(g_scratch + offset);
+			prev_top = g_scratchTop;
+			g_scratchTop = offset + n * sizeof(T);
 		}
-
-		if(j->parent)
+		else
 		{
-			--j->parent->jobs_running;
-			if(!j->parent->jobs_running)
-			{
-				j->parent->finished = true;
-				std::atomic_notify_all(&j->parent->finished);
-			}
-			j->parent = nullptr;
+			items = static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t{alignof(T)}));
+			on_heap = true;
+			count_heap_allocation();
 		}
 
-		if(this_thread.active_job == j)
-			this_thread.active_job = nullptr;
+		std::uninitialized_fill_n(items, count, value);
+	}
+
+	~ScratchArray()
+	{
+		std::destroy_n(items, count);
+
+		if(on_heap)
+			::operator delete(items, std::align_val_t{alignof(T)});
+		else
+			g_scratchTop = prev_top;
+	}
+
+	ScratchArray(const ScratchArray&) = delete;
+	ScratchArray& operator=(const ScratchArray&) = delete;
+
+	T& operator[](size_t i) noexcept
+	{
+		return items[i];
+	}
+
+	T* begin() noexcept
+	{
+		return items;
+	}
 
-		--ctx->jobs_running;
-		if(ctx->waiting && !ctx->jobs_running && ctx->jobs.empty())
-			ctx->work_done.notify_all();
+	T* end() noexcept
+	{
+		return items + count;
 	}
+private:
+	T* items{nullptr};
+	size_t count{0u};
+	size_t prev_top{0u};
+	bool on_heap{false};
+};
+
+void notify_work(Priority priority)
+{
+	WakeLane& lane = ctx->lanes[priority == Priority::Background && ctx->num_io_threads];
+
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if(!lane.sleeping.load(std::memory_order_relaxed))
+		return;
 
-	delete[] g_jobAllocator;
+	lane.signal.fetch_add(1u, std::memory_order_release);
+
+	// threads waiting in help_until park on the compute lane too but leave background jobs alone, a single wake-up could be swallowed by one of them
+	if(priority == Priority::Background && !ctx->num_io_threads)
+		lane.signal.notify_all();
+	else
+		lane.signal.notify_one();
 }
 
+job_t* find_job(uint32_t id, Priority priority)
+{
+	const auto queue = std::to_underlying(priority);
+	if(job_t* j = ctx->threads[id].jobs[queue].pop())
+		return j;
+
+	const uint32_t count = ctx->total_threads();
+	for(uint32_t i = 1; i < count; i++)
+	{
+		if(job_t* j = ctx->threads[(id + i) % count].jobs[queue].steal())
+			return j;
+	}
+
+	InjectionQueue& injected = ctx->injected;
+	if(!injected.queued.load(std::memory_order_acquire))
+		return nullptr;
+
+	std::scoped_lock<std::mutex> lock{injected.lock};
+	if(injected.jobs[queue].empty())
+		return nullptr;
+
+	job_t* j = injected.jobs[queue].front();
+	injected.jobs[queue].pop_front();
+	injected.queued.fetch_sub(1u, std::memory_order_relaxed);
+	return j;
 }
 
-export namespace lumina::job
+// nonzero while this thread runs a background job it holds a claim for, nested background work needs no further claim
+static thread_local uint32_t background_depth = 0u;
+
+struct NextJob
 {
+	job_t* job{nullptr};
+	bool background_claim{false};
+
+	explicit operator bool() const noexcept
+	{
+		return job != nullptr;
+	}
+};
 
-void init(uint32_t concurrency = 0)
+bool background_queued()
 {
-	ctx = new JobSystemContext();
+	const auto queue = std::to_underlying(Priority::Background);
+	for(uint32_t i = 0; i < ctx->total_threads(); i++)
+	{
+		if(!ctx->threads[i].jobs[queue].empty())
+			return true;
+	}
 
-	if(concurrency == 0)
-		concurrency = std::thread::hardware_concurrency();
+	if(!ctx->injected.queued.load(std::memory_order_acquire))
+		return false;
 
-	log::info("job_system: running on {} threads", concurrency);
+	std::scoped_lock<std::mutex> lock{ctx->injected.lock};
+	return !ctx->injected.jobs[queue].empty();
+}
 
-	#if defined(__clang__) || defined(__GNUC__) || defined(__GNUG__)
-	log::info("job_system: cache line {} bytes, expanding job_t by {} bytes", cache_line_size, job_padding_size);
-	#endif
+// a thread turned away by the claim limit went back to sleep, hand the free slot to it if there is still work
+void release_background_claim()
+{
+	ctx->background_running.fetch_sub(1u, std::memory_order_release);
+	if(background_queued())
+		notify_work(Priority::Background);
+}
 
-	ctx->num_threads = concurrency - 1;
-	ctx->threads = std::make_unique_for_overwrite<ThreadInfo[]>(ctx->num_threads);	
+// compute threads drain priorities in order, I/O threads only ever run background jobs.
+// without claim_background a compute thread skips background jobs it would need a new claim for.
+NextJob next_job(uint32_t id, bool claim_background = true)
+{
+	if(ctx->is_io_thread(id))
+		return {find_job(id, Priority::Background)};
 
-	current_thread_id = 0;
-	g_jobAllocator = new job_t[max_concurrent_jobs];
+	for(auto priority : {Priority::Critical, Priority::Normal})
+	{
+		if(job_t* j = find_job(id, priority))
+			return {j};
+	}
 
-	ctx->running = true;
+	if(ctx->num_io_threads)
+		return {};
 
-	for(uint32_t i = 0; i < ctx->num_threads; ++i)
+	if(background_depth)
+		return {find_job(id, Priority::Background)};
+
+	if(!claim_background)
+		return {};
+
+	if(ctx->background_running.fetch_add(1u, std::memory_order_acquire) >= ctx->max_background_workers)
 	{
-		ctx->threads[i].name = "worker" + std::to_string(i + 1);
-		ctx->threads[i].thread = std::thread(worker, i);
+		ctx->background_running.fetch_sub(1u, std::memory_order_relaxed);
+		return {};
 	}
+
+	if(job_t* j = find_job(id, Priority::Background))
+		return {j, true};
+
+	release_background_claim();
+	return {};
 }
 
-void wait_for_work()
+void finish_job(job_t* j)
 {
-	std::unique_lock<std::mutex> lock{ctx->jobs_mutex};
+	if(j->jobs_running.fetch_sub(1u, std::memory_order_acq_rel) != 1u)
+		return;
+
+	// the slot may be recycled as soon as the new generation is visible
+	job_t* parent = j->parent;
+	j->parent = nullptr;
+
+	j->generation.fetch_add(1u, std::memory_order_release);
+	j->generation.notify_all();
 
-	ctx->waiting = true;
-	ctx->work_done.wait(lock, []
+	if(parent)
+		finish_job(parent);
+
+	if(ctx->jobs_pending.fetch_sub(1u, std::memory_order_acq_rel) == 1u)
+		ctx->jobs_pending.notify_all();
+
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if(ctx->helpers.load(std::memory_order_relaxed))
 	{
-		return !ctx->jobs_running && ctx->jobs.empty();
-	});
-	ctx->waiting = false;
+		for(auto& lane : ctx->lanes)
+		{
+			lane.signal.fetch_add(1u, std::memory_order_release);
+			lane.signal.notify_all();
+		}
+	}
 }
 
-void shutdown()
+void execute_job(job_t* j)
 {
-	wait_for_work();
-	ctx->running = false;
-	ctx->work_available.notify_all();
+	auto& this_thread = ctx->threads[current_thread_id];
 
-	for(uint32_t i = 0; i < ctx->num_threads; i++)
-		ctx->threads[i].thread.join();
+	job_t* prev_job = this_thread.active_job;
+	this_thread.active_job = j;
+	j->invoke(j->storage);
+	this_thread.active_job = prev_job;
 
-	delete[] g_jobAllocator;
-	delete ctx;
+	finish_job(j);
 }
 
-void wait(job_t* j)
+void run_job(NextJob next)
 {
-	std::atomic_wait(&j->finished, false);
+	if(!next.background_claim)
+	{
+		execute_job(next.job);
+		return;
+	}
+
+	background_depth++;
+	execute_job(next.job);
+	background_depth--;
+	release_background_claim();
 }
 
-void wait(const std::vector<job_t*>& jobs)
+void worker(uint32_t id)
 {
-	for(auto job : jobs)
-		std::atomic_wait(&job->finished, false);
+	current_thread_id = id;
+	init_thread_storage();
+
+	WakeLane& lane = ctx->lane_of(id);
+
+	while(ctx->running.load(std::memory_order_acquire))
+	{
+		if(NextJob next = next_job(id))
+		{
+			run_job(next);
+			continue;
+		}
+
+		const uint32_t signal = lane.signal.load(std::memory_order_acquire);
+		lane.sleeping.fetch_add(1u, std::memory_order_seq_cst);
+
+		// recheck after announcing ourselves, a producer that missed the sleeper count has already published its job
+		if(NextJob next = next_job(id))
+		{
+			lane.sleeping.fetch_sub(1u, std::memory_order_relaxed);
+			run_job(next);
+			continue;
+		}
+
+		if(ctx->running.load(std::memory_order_acquire))
+			lane.signal.wait(signal, std::memory_order_acquire);
+
+		lane.sleeping.fetch_sub(1u, std::memory_order_relaxed);
+	}
+
+	destroy_thread_storage();
 }
 
-void wait(std::initializer_list<job_t*> jobs)
+// a worker blocked in several nested waits is only counted once
+static thread_local uint32_t wait_depth = 0u;
+
+// waiting compute threads leave background jobs to the idle workers so a frame-critical wait never sits behind a long
+// background job, unless every worker is blocked in a wait itself and nobody else would ever run them
+bool may_claim_background()
 {
-	for(auto job : jobs)
-		std::atomic_wait(&job->finished, false);
+	return ctx->waiting_workers.load(std::memory_order_acquire) == ctx->num_threads;
 }
 
-job_t* schedule(std::function<void()>&& f)
+// runs pending jobs on the calling thread until done() holds, parks only when there is nothing left to steal
+template <typename Pred>
+void help_until(Pred&& done)
 {
-	job_t* j = allocate_job();
-	j->func = std::move(f);
-	j->finished = false;
-	j->jobs_running = 1u;
+	const uint32_t id = current_thread_id;
 
-	if(current_thread_id)
+	// threads the job system does not own have no deques to run jobs from, they park until finishing jobs wake the helpers
+	if(!ctx->is_job_thread(id)) [[unlikely]]
 	{
+		WakeLane& lane = ctx->lanes[0];
+		while(!done())
+		{
+			const uint32_t signal = lane.signal.load(std::memory_order_acquire);
+			ctx->helpers.fetch_add(1u, std::memory_order_seq_cst);
 
-	auto& this_thread = ctx->threads[current_thread_id];
-	if(this_thread.active_job)
+			if(!done())
+				lane.signal.wait(signal, std::memory_order_acquire);
+
+			ctx->helpers.fetch_sub(1u, std::memory_order_relaxed);
+		}
+
+		return;
+	}
+
+	WakeLane& lane = ctx->lane_of(id);
+
+	const bool is_worker = ctx->is_compute_worker(id);
+	if(is_worker && wait_depth++ == 0)
+		ctx->waiting_workers.fetch_add(1u, std::memory_order_seq_cst);
+
+	while(!done())
 	{
-		this_thread.active_job->jobs_running++;
-		j->parent = this_thread.active_job;
+		if(NextJob next = next_job(id, may_claim_background()))
+		{
+			run_job(next);
+			continue;
+		}
+
+		const uint32_t signal = lane.signal.load(std::memory_order_acquire);
+		ctx->helpers.fetch_add(1u, std::memory_order_seq_cst);
+		lane.sleeping.fetch_add(1u, std::memory_order_seq_cst);
+
+		NextJob next{};
+		if(!done() && !(next = next_job(id, may_claim_background())))
+			lane.signal.wait(signal, std::memory_order_acquire);
+
+		lane.sleeping.fetch_sub(1u, std::memory_order_relaxed);
+		ctx->helpers.fetch_sub(1u, std::memory_order_relaxed);
+
+		if(next)
+			run_job(next);
 	}
-	else
+
+	if(is_worker && --wait_depth == 0)
+		ctx->waiting_workers.fetch_sub(1u, std::memory_order_release);
+}
+
+// constructs the callable in the slot and marks it in flight, returns the generation of this run
+template <typename Fn>
+uint32_t emplace_job(job_t* j, Fn&& f)
+{
+	using callable_type = std::decay_t<Fn>;
+	static_assert(sizeof(callable_type) <= job_t::storage_size, "job callable does not fit into job_t storage, capture state by reference or pointer");
+	static_assert(alignof(callable_type) <= job_t::storage_align, "job callable is over-aligned for job_t storage");
+
+	::new (static_cast<void*>(j->storage)) callable_type(std::forward<Fn>(f));
+	j->invoke = [](void* storage)
+	{
+		callable_type& fn = *std::launder(reinterpret_cast<callable_type*>(storage));
+		fn();
+		fn.~callable_type();
+	};
+	const uint32_t generation = j->generation.load(std::memory_order_relaxed) + 1u;
+	j->generation.store(generation, std::memory_order_relaxed);
+	j->jobs_running = 1u;
+
+	return generation;
+}
+
+// detached jobs do not extend the lifetime of the job that scheduled them, used to resume coroutines
+template <typename Fn>
+job_handle schedule_job(Fn&& f, Priority priority, bool detached)
+{
+	// jobs from threads the job system does not own go through the locked injection queue, they never have a parent
+	if(!ctx->is_job_thread(current_thread_id)) [[unlikely]]
 	{
-		j->parent = nullptr;
+		InjectionQueue& injected = ctx->injected;
+		job_handle handle;
+
+		{
+			std::scoped_lock<std::mutex> lock{injected.lock};
+			job_t* j = allocate_job(injected.ring);
+			handle = {j, emplace_job(j, std::forward<Fn>(f))};
+			j->parent = nullptr;
+
+			ctx->jobs_pending.fetch_add(1u, std::memory_order_relaxed);
+			injected.jobs[std::to_underlying(priority)].push_back(j);
+			injected.queued.fetch_add(1u, std::memory_order_release);
+		}
+
+		notify_work(priority);
+		return handle;
 	}
 
+	job_t* j = allocate_job(g_jobRing);
+	const uint32_t generation = emplace_job(j, std::forward<Fn>(f));
+
+	auto& this_thread = ctx->threads[current_thread_id];
+	j->parent = detached ? nullptr : this_thread.active_job;
+	if(j->parent)
+		j->parent->jobs_running.fetch_add(1u, std::memory_order_relaxed);
+
+	this_thread.jobs_scheduled.fetch_add(1u, std::memory_order_relaxed);
+	ctx->jobs_pending.fetch_add(1u, std::memory_order_relaxed);
+	this_thread.jobs[std::to_underlying(priority)].push(j);
+	notify_work(priority);
+
+	return {j, generation};
+}
+
+}
+
+export namespace lumina::job
+{
+
+// io_threads adds dedicated threads that only run Priority::Background jobs, so blocking file access never occupies a compute core.
+// They are numbered after the compute workers and must not record vulkan command buffers.
+void init(uint32_t concurrency = 0, uint32_t io_threads = 0)
+{
+	ctx = new JobSystemContext();
+
+	if(concurrency == 0)
+		concurrency = std::thread::hardware_concurrency();
+
+	log::info("job_system: running on {} threads, {} dedicated io threads", concurrency, io_threads);
+
+	log::info("job_system: job_t {} bytes, {} bytes inline callable storage", sizeof(job_t), job_t::storage_size);
+
+	ctx->num_threads = concurrency - 1;
+	ctx->num_io_threads = io_threads;
+	// one compute worker always stays free for higher priorities, a single worker has to take background jobs too
+	ctx->max_background_workers = std::max(ctx->num_threads, 2u) - 1u;
+	ctx->threads = std::make_unique<ThreadInfo[]>(ctx->total_threads());
+	ctx->injected.ring.slots = std::make_unique<job_t[]>(injected_job_ring_size);
+	ctx->injected.ring.mask = injected_job_ring_size - 1;
+
+	current_thread_id = 0;
+	ctx->threads[0].name = "main";
+	init_thread_storage();
+
+	ctx->running = true;
+
+	for(uint32_t i = 1; i <= ctx->num_threads; ++i)
+	{
+		ctx->threads[i].name = "worker" + std::to_string(i);
+		ctx->threads[i].thread = std::thread(worker, i);
 	}
 
+	for(uint32_t i = ctx->num_threads + 1; i < ctx->total_threads(); ++i)
 	{
-		const std::scoped_lock<std::mutex> lock{ctx->jobs_mutex};
-		ctx->jobs.push(j);
+		ctx->threads[i].name = "io" + std::to_string(i - ctx->num_threads);
+		ctx->threads[i].thread = std::thread(worker, i);
 	}
+}
 
-	ctx->work_available.notify_one();
-	return j;
+// compute threads only, dedicated I/O threads are not counted. Zero while the job system is not running
+uint32_t get_thread_count()
+{
+	return ctx ? ctx->num_threads + 1 : 0u;
+}
+
+struct Stats
+{
+	uint64_t jobs_scheduled;
+	uint64_t heap_allocations;
+};
+
+// totals over all job threads, the heap allocation count stays flat once every thread is up and running
+Stats get_stats()
+{
+	Stats stats{0u, 0u};
+	for(uint32_t i = 0; i < ctx->total_threads(); i++)
+	{
+		stats.jobs_scheduled += ctx->threads[i].jobs_scheduled.load(std::memory_order_relaxed);
+		stats.heap_allocations += ctx->threads[i].heap_allocations.load(std::memory_order_relaxed);
+	}
+
+	return stats;
+}
+
+void wait_for_work()
+{
+	help_until([]
+	{
+		return ctx->jobs_pending.load(std::memory_order_acquire) == 0u;
+	});
+}
+
+void shutdown()
+{
+	wait_for_work();
+	ctx->running = false;
+	for(auto& lane : ctx->lanes)
+	{
+		lane.signal.fetch_add(1u, std::memory_order_release);
+		lane.signal.notify_all();
+	}
+
+	for(uint32_t i = 1; i < ctx->total_threads(); i++)
+		ctx->threads[i].thread.join();
+
+	destroy_thread_storage();
+	delete ctx;
+	ctx = nullptr;
+}
+
+void wait(job_handle h)
+{
+	help_until([h]
+	{
+		return h.is_finished();
+	});
+}
+
+void wait(const std::vector<job_handle>& jobs)
+{
+	for(auto job : jobs)
+		wait(job);
+}
+
+void wait(std::initializer_list<job_handle> jobs)
+{
+	for(auto job : jobs)
+		wait(job);
+}
+
+// runs pending jobs until done() holds. done is re-checked whenever a job finishes, so it must become true
+// as a side effect of some job completing
+template <typename Pred>
+void wait_until(Pred&& done)
+{
+	help_until(std::forward<Pred>(done));
+}
+
+template <typename Fn>
+requires std::is_invocable_r_v<void, std::decay_t<Fn>&>
+job_handle schedule(Fn&& f, Priority priority = Priority::Normal)
+{
+	return schedule_job(std::forward<Fn>(f), priority, false);
+}
+
+job_handle schedule(void (*fn)(void*), void* userdata, Priority priority = Priority::Normal)
+{
+	return schedule([fn, userdata]
+	{
+		fn(userdata);
+	}, priority);
+}
+
+}
+
+namespace lumina::job
+{
+
+// chunk boundaries depend only on count and grain, never on which thread picks the work up
+struct ChunkLayout
+{
+	size_t count;
+	size_t grain;
+	size_t chunks;
+};
+
+ChunkLayout make_chunk_layout(size_t count, size_t grain)
+{
+	if(grain == 0)
+	{
+		// a few chunks per thread leaves enough slack for stealing to even out uneven work
+		const size_t target = 8zu * std::max(get_thread_count(), 1u);
+		grain = std::max((count + target - 1) / target, 1zu);
+	}
+
+	return {count, grain, (count + grain - 1) / grain};
+}
+
+template <typename Body>
+struct ChunkDispatch
+{
+	ChunkLayout layout;
+	Body& body;
+	std::atomic<uint32_t> remaining{0u};
+};
+
+// halves the chunk range, hands the upper half to the pool and keeps descending into the lower half
+template <typename Body>
+void split_chunks(ChunkDispatch<Body>& dispatch, size_t first, size_t last)
+{
+	while(last - first > 1)
+	{
+		const size_t mid = first + (last - first) / 2;
+		dispatch.remaining.fetch_add(1u, std::memory_order_relaxed);
+		schedule([&dispatch, mid, last]
+		{
+			split_chunks(dispatch, mid, last);
+			dispatch.remaining.fetch_sub(1u, std::memory_order_release);
+		});
+		last = mid;
+	}
+
+	const ChunkLayout& l = dispatch.layout;
+	dispatch.body(first, first * l.grain, std::min(l.count, (first + 1) * l.grain));
+}
+
+template <typename Body>
+void run_chunks(const ChunkLayout& layout, Body& body)
+{
+	if(!layout.chunks)
+		return;
+
+	if(layout.chunks == 1 || !ctx)
+	{
+		for(size_t c = 0; c < layout.chunks; c++)
+			body(c, c * layout.grain, std::min(layout.count, (c + 1) * layout.grain));
+
+		return;
+	}
+
+	ChunkDispatch<Body> dispatch{layout, body};
+	split_chunks(dispatch, 0, layout.chunks);
+	help_until([&dispatch]
+	{
+		return dispatch.remaining.load(std::memory_order_acquire) == 0u;
+	});
+}
+
+}
+
+export namespace lumina::job
+{
+
+// pass as grain to let the job system pick a chunk size from the range length and thread count
+constexpr size_t auto_grain = 0zu;
+
+// calls fn on every element of range, elements are processed in chunks of grain on all job threads
+template <std::ranges::random_access_range R, typename Fn>
+requires std::ranges::sized_range<R>
+void parallel_for(R&& range, size_t grain, Fn&& fn)
+{
+	using diff_type = std::ranges::range_difference_t<R>;
+
+	const auto first = std::ranges::begin(range);
+	auto body = [&first, &fn](size_t, size_t b, size_t e)
+	{
+		for(size_t i = b; i < e; i++)
+			fn(first[static_cast<diff_type>(i)]);
+	};
+
+	run_chunks(make_chunk_layout(static_cast<size_t>(std::ranges::size(range)), grain), body);
+}
+
+// map-reduce over range, partial results are combined in chunk order so the result does not depend on scheduling
+template <std::ranges::random_access_range R, typename T, typename Map, typename Reduce>
+requires std::ranges::sized_range<R>
+T parallel_reduce(R&& range, size_t grain, T identity, Map&& map, Reduce&& reduce)
+{
+	using diff_type = std::ranges::range_difference_t<R>;
+
+	const ChunkLayout layout = make_chunk_layout(static_cast<size_t>(std::ranges::size(range)), grain);
+	ScratchArray<T> partials(layout.chunks, identity);
+
+	const auto first = std::ranges::begin(range);
+	auto body = [&first, &map, &reduce, &identity, &partials](size_t chunk, size_t b, size_t e)
+	{
+		T acc = identity;
+		for(size_t i = b; i < e; i++)
+			acc = reduce(std::move(acc), map(first[static_cast<diff_type>(i)]));
+
+		partials[chunk] = std::move(acc);
+	};
+
+	run_chunks(layout, body);
+
+	T result = std::move(identity);
+	for(auto& p : partials)
+		result = reduce(std::move(result), std::move(p));
+
+	return result;
+}
+
+}
+
+export namespace lumina::job
+{
+
+// fixed DAG of jobs, nodes and edges are declared once and the graph is re-run every frame without allocating.
+// a node is scheduled as soon as its last predecessor finishes
+class Graph
+{
+public:
+	using node_id = uint32_t;
+
+	Graph() = default;
+
+	Graph(const Graph&) = delete;
+	Graph(Graph&&) = delete;
+
+	Graph& operator=(const Graph&) = delete;
+	Graph& operator=(Graph&&) = delete;
+
+	node_id add_node(std::string name, std::function<void()>&& fn, Priority priority = Priority::Normal)
+	{
+		nodes.push_back({std::move(name), std::move(fn), priority});
+		compiled = false;
+		return static_cast<node_id>(nodes.size() - 1);
+	}
+
+	void add_edge(node_id from, node_id to)
+	{
+		assert(from < nodes.size() && to < nodes.size() && from != to);
+		edges.emplace_back(from, to);
+		compiled = false;
+	}
+
+	// builds successor lists and checks for cycles, run() calls this whenever the graph changed
+	bool compile()
+	{
+		const auto count = static_cast<uint32_t>(nodes.size());
+
+		for(auto& node : nodes)
+		{
+			node.num_predecessors = 0u;
+			node.num_successors = 0u;
+		}
+
+		std::ranges::sort(edges);
+		const auto last = std::ranges::unique(edges);
+		edges.erase(last.begin(), last.end());
+
+		successors.resize(edges.size());
+		for(uint32_t i = 0; auto [from, to] : edges)
+		{
+			if(!nodes[from].num_successors)
+				nodes[from].first_successor = i;
+
+			nodes[from].num_successors++;
+			nodes[to].num_predecessors++;
+			successors[i++] = to;
+		}
+
+		topo_order.clear();
+		topo_order.reserve(count);
+
+		std::vector<uint32_t> indegree(count);
+		for(node_id i = 0; i < count; i++)
+		{
+			indegree[i] = nodes[i].num_predecessors;
+			if(!indegree[i])
+				topo_order.push_back(i);
+		}
+
+		roots.assign(topo_order.begin(), topo_order.end());
+
+		for(size_t i = 0; i < topo_order.size(); i++)
+		{
+			const Node& node = nodes[topo_order[i]];
+			for(uint32_t s = node.first_successor; s < node.first_successor + node.num_successors; s++)
+			{
+				if(!--indegree[successors[s]])
+					topo_order.push_back(successors[s]);
+			}
+		}
+
+		if(topo_order.size() != count)
+		{
+			log::critical("job_graph: graph contains a cycle, {} of {} nodes reachable", topo_order.size(), count);
+			return false;
+		}
+
+		pending = std::make_unique<std::atomic<uint32_t>[]>(count);
+		compiled = true;
+		return true;
+	}
+
+	// schedules the root nodes and helps until every node has finished
+	void run()
+	{
+		if(!compiled && !compile())
+			return;
+
+		if(nodes.empty())
+			return;
+
+		for(size_t i = 0; i < nodes.size(); i++)
+			pending[i].store(nodes[i].num_predecessors, std::memory_order_relaxed);
+
+		remaining.store(static_cast<uint32_t>(nodes.size()), std::memory_order_relaxed);
+		run_start = std::chrono::steady_clock::now();
+
+		for(node_id root : roots)
+			schedule_node(root);
+
+		help_until([this]
+		{
+			return remaining.load(std::memory_order_acquire) == 0u;
+		});
+	}
+
+	// logs start, duration and thread of every node from the last run() and marks the critical path
+	void dump_timings() const
+	{
+		if(!compiled || nodes.empty())
+			return;
+
+		std::vector<int64_t> path_end(nodes.size(), 0);
+		std::vector<node_id> path_prev(nodes.size(), ~0u);
+
+		for(node_id id : topo_order)
+		{
+			const Node& node = nodes[id];
+			path_end[id] += node.end - node.start;
+
+			for(uint32_t s = node.first_successor; s < node.first_successor + node.num_successors; s++)
+			{
+				const node_id succ = successors[s];
+				if(path_end[id] > path_end[succ])
+				{
+					path_end[succ] = path_end[id];
+					path_prev[succ] = id;
+				}
+			}
+		}
+
+		std::vector<bool> critical(nodes.size(), false);
+		node_id tail = static_cast<node_id>(std::ranges::max_element(path_end) - path_end.begin());
+		for(node_id id = tail; id != ~0u; id = path_prev[id])
+			critical[id] = true;
+
+		auto to_ms = [](int64_t ns)
+		{
+			return static_cast<double>(ns) / 1000000.0;
+		};
+
+		log::info("job_graph: {} nodes, critical path {:.3f}ms", nodes.size(), to_ms(path_end[tail]));
+		for(node_id id : topo_order)
+		{
+			const Node& node = nodes[id];
+			log::info("job_graph: {:<32} thread {:>2} start {:8.3f}ms duration {:8.3f}ms{}", node.name, node.thread, to_ms(node.start), to_ms(node.end - node.start), critical[id] ? " [critical]" : "");
+		}
+	}
+private:
+	struct Node
+	{
+		std::string name;
+		std::function<void()> func;
+		Priority priority;
+
+		uint32_t num_predecessors{0u};
+		uint32_t first_successor{0u};
+		uint32_t num_successors{0u};
+
+		// filled in by the thread running the node, nanoseconds since run_start
+		int64_t start{0};
+		int64_t end{0};
+		uint32_t thread{0u};
+	};
+
+	int64_t elapsed_ns() const
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - run_start).count();
+	}
+
+	void schedule_node(node_id id)
+	{
+		schedule([this, id]
+		{
+			run_node(id);
+		}, nodes[id].priority);
+	}
+
+	void run_node(node_id id)
+	{
+		Node& node = nodes[id];
+		node.thread = get_thread_id();
+		node.start = elapsed_ns();
+		node.func();
+		node.end = elapsed_ns();
+
+		for(uint32_t s = node.first_successor; s < node.first_successor + node.num_successors; s++)
+		{
+			if(pending[successors[s]].fetch_sub(1u, std::memory_order_acq_rel) == 1u)
+				schedule_node(successors[s]);
+		}
+
+		remaining.fetch_sub(1u, std::memory_order_release);
+	}
+
+	std::vector<Node> nodes;
+	std::vector<std::pair<node_id, node_id>> edges;
+
+	std::vector<node_id> successors;
+	std::vector<node_id> roots;
+	std::vector<node_id> topo_order;
+	std::unique_ptr<std::atomic<uint32_t>[]> pending;
+
+	std::atomic<uint32_t> remaining{0u};
+	std::chrono::steady_clock::time_point run_start;
+	bool compiled{false};
+};
+
+}
+
+export namespace lumina::job
+{
+
+template <typename T = void>
+class task;
+
+}
+
+namespace lumina::job
+{
+
+struct TaskPromiseBase
+{
+	struct FinalAwaiter
+	{
+		bool await_ready() const noexcept
+		{
+			return false;
+		}
+
+		template <typename Promise>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept
+		{
+			return h.promise().continuation;
+		}
+
+		void await_resume() const noexcept {}
+	};
+
+	std::suspend_always initial_suspend() const noexcept
+	{
+		return {};
+	}
+
+	FinalAwaiter final_suspend() const noexcept
+	{
+		return {};
+	}
+
+	void unhandled_exception() noexcept
+	{
+		exception = std::current_exception();
+	}
+
+	std::coroutine_handle<> continuation{std::noop_coroutine()};
+	std::exception_ptr exception;
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase
+{
+	task<T> get_return_object() noexcept;
+
+	template <typename U>
+	void return_value(U&& v)
+	{
+		value.emplace(std::forward<U>(v));
+	}
+
+	T result()
+	{
+		if(exception)
+			std::rethrow_exception(exception);
+
+		return std::move(*value);
+	}
+
+	std::optional<T> value;
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase
+{
+	task<void> get_return_object() noexcept;
+
+	void return_void() noexcept {}
+
+	void result()
+	{
+		if(exception)
+			std::rethrow_exception(exception);
+	}
+};
+
+// drives a task from a plain thread, done is only set once the coroutine is fully suspended so the frame can be destroyed right after
+struct SyncWaitTask
+{
+	struct promise_type
+	{
+		struct FinalAwaiter
+		{
+			bool await_ready() const noexcept
+			{
+				return false;
+			}
+
+			void await_suspend(std::coroutine_handle<promise_type> h) noexcept
+			{
+				h.promise().done.store(true, std::memory_order_release);
+			}
+
+			void await_resume() const noexcept {}
+		};
+
+		SyncWaitTask get_return_object() noexcept
+		{
+			return {std::coroutine_handle<promise_type>::from_promise(*this)};
+		}
+
+		std::suspend_always initial_suspend() const noexcept
+		{
+			return {};
+		}
+
+		FinalAwaiter final_suspend() const noexcept
+		{
+			return {};
+		}
+
+		void return_void() const noexcept {}
+
+		void unhandled_exception() noexcept
+		{
+			exception = std::current_exception();
+		}
+
+		std::atomic<bool> done{false};
+		std::exception_ptr exception;
+	};
+
+	std::coroutine_handle<promise_type> handle;
+};
+
+// fire and forget wrapper, the frame destroys itself when the wrapped task completes
+struct DetachedTask
+{
+	struct promise_type
+	{
+		DetachedTask get_return_object() const noexcept
+		{
+			return {};
+		}
+
+		std::suspend_never initial_suspend() const noexcept
+		{
+			return {};
+		}
+
+		std::suspend_never final_suspend() const noexcept
+		{
+			return {};
+		}
+
+		void return_void() const noexcept {}
+
+		void unhandled_exception() const noexcept
+		{
+			std::terminate();
+		}
+	};
+};
+
+}
+
+export namespace lumina::job
+{
+
+// lazily started coroutine, runs on whichever job thread resumes it and continues the awaiting coroutine when it completes
+template <typename T>
+class task
+{
+public:
+	using promise_type = TaskPromise<T>;
+
+	task() = default;
+	explicit task(std::coroutine_handle<promise_type> h) noexcept : handle{h} {}
+
+	~task()
+	{
+		if(handle)
+			handle.destroy();
+	}
+
+	task(const task&) = delete;
+	task& operator=(const task&) = delete;
+
+	task(task&& other) noexcept : handle{std::exchange(other.handle, nullptr)} {}
+	task& operator=(task&& other) noexcept
+	{
+		if(this != &other)
+		{
+			if(handle)
+				handle.destroy();
+
+			handle = std::exchange(other.handle, nullptr);
+		}
+
+		return *this;
+	}
+
+	auto operator co_await() & noexcept
+	{
+		return awaiter{handle};
+	}
+
+	auto operator co_await() && noexcept
+	{
+		return awaiter{handle};
+	}
+private:
+	struct awaiter
+	{
+		std::coroutine_handle<promise_type> handle;
+
+		// a default constructed or moved from task has no coroutine to run and no result to hand back
+		bool await_ready() const noexcept
+		{
+			assert(handle && "awaited an empty job::task");
+			return handle.done();
+		}
+
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+		{
+			handle.promise().continuation = awaiting;
+			return handle;
+		}
+
+		T await_resume()
+		{
+			return handle.promise().result();
+		}
+	};
+
+	// only waits for completion, the result stays in the promise for sync_wait to take
+	struct completion_awaiter : awaiter
+	{
+		void await_resume() const noexcept {}
+	};
+
+	template <typename U>
+	friend U sync_wait(task<U> t);
+
+	std::coroutine_handle<promise_type> handle{nullptr};
+};
+
+// suspends the awaiting coroutine and resumes it from a fresh job of the given priority.
+// Priority::Background moves the coroutine onto a dedicated I/O thread when the job system has any
+inline auto schedule_on(Priority priority)
+{
+	struct awaiter
+	{
+		Priority priority;
+
+		bool await_ready() const noexcept
+		{
+			return false;
+		}
+
+		void await_suspend(std::coroutine_handle<> h) const
+		{
+			schedule_job([h]
+			{
+				h.resume();
+			}, priority, true);
+		}
+
+		void await_resume() const noexcept {}
+	};
+
+	return awaiter{priority};
+}
+
+// starts t on the calling thread and helps running jobs until it has completed
+template <typename T>
+T sync_wait(task<T> t)
+{
+	auto make_waiter = [](task<T>& inner) -> SyncWaitTask
+	{
+		co_await typename task<T>::completion_awaiter{inner.handle};
+	};
+
+	SyncWaitTask waiter = make_waiter(t);
+	waiter.handle.resume();
+	help_until([&waiter]
+	{
+		return waiter.handle.promise().done.load(std::memory_order_acquire);
+	});
+
+	std::exception_ptr exception = std::move(waiter.handle.promise().exception);
+	waiter.handle.destroy();
+
+	if(exception)
+		std::rethrow_exception(exception);
+
+	return t.handle.promise().result();
+}
+
+// runs t to completion in the background, wait_for_work also waits for spawned tasks
+void spawn(task<void> t, Priority priority = Priority::Normal)
+{
+	[](task<void> inner, Priority p) -> DetachedTask
+	{
+		co_await schedule_on(p);
+		co_await inner;
+	}(std::move(t), priority);
+}
+
+}
+
+namespace lumina::job
+{
+
+template <typename T>
+task<T> TaskPromise<T>::get_return_object() noexcept
+{
+	return task<T>{std::coroutine_handle<TaskPromise<T>>::from_promise(*this)};
+}
+
+task<void> TaskPromise<void>::get_return_object() noexcept
+{
+	return task<void>{std::coroutine_handle<TaskPromise<void>>::from_promise(*this)};
 }
 
 }
-	
@@ -1,5 +1,7 @@
 module;
 
+#include <cassert>
+
 #if defined LUMINA_PLATFORM_POSIX
 #include <sys/mman.h>
 #include <cerrno>
@@ -14,20 +16,25 @@ module;
 export module lumina.core:object_pool;
 export import :handle;
 import lumina.core.log;
+import lumina.core.job;
 
 import std;
 
-using std::size_t, std::uint32_t, std::uint64_t;
+using std::size_t, std::uint8_t, std::uint32_t, std::uint64_t;
 
 export namespace lumina
 {
 
+// objects live in one reserved virtual range that is committed a chunk at a time as the pool grows,
+// handles stay plain indices into that range so get() is a single indexed load
 template <typename T>
 class ObjectPool
 {
 public:
 	using handle_type = Handle<T>;
+	using generational_handle_type = GenerationalHandle<T>;
 	constexpr static uint32_t invalid_object = 0xFFFFFFFF;
+	constexpr static uint32_t default_reserved_objects = 1u << 22;
 	static_assert(std::atomic<uint32_t>::is_always_lock_free, "atomic u32 must be lock free");
 	static_assert(std::atomic<uint32_t>::is_always_lock_free, "atomic u64 must be lock free");
 
@@ -35,12 +42,34 @@ public:
 	{
 		T data;
 		std::atomic<uint32_t> next{invalid_object};
+		uint32_t generation{0};
 	};
 	static_assert(alignof(InternalObject) == alignof(T));
 
+	// chunks are a whole number of pages and at least 64k so commits and releases never straddle a neighbour
+	constexpr static size_t page_size = 4096u;
+	constexpr static uint32_t chunk_objects = []
+	{
+		const size_t page_objects = page_size / std::gcd(sizeof(InternalObject), page_size);
+		const size_t page_bytes = page_objects * sizeof(InternalObject);
+		return static_cast<uint32_t>(page_objects * ((65536u + page_bytes - 1) / page_bytes));
+	}();
+	constexpr static size_t chunk_bytes = chunk_objects * sizeof(InternalObject);
+
+	// free slots cached per job thread, refilled from and flushed to the shared free list a magazine at a time
+	constexpr static uint32_t max_magazine_size = 32;
+	struct alignas(64) ThreadCache
+	{
+		uint32_t count = 0;
+		std::array<uint32_t, 2 * max_magazine_size> slots;
+	};
+
 	ObjectPool(std::string_view unique_name) : name{unique_name} {}
 	~ObjectPool()
 	{
+		for(auto& segment : chunk_segments)
+			delete[] segment.load(std::memory_order_relaxed);
+
 		#if defined LUMINA_PLATFORM_POSIX
 		munmap(objects, map_length);
 		#elif defined LUMINA_PLATFORM_WIN32
@@ -54,75 +83,101 @@ public:
 	ObjectPool& operator=(const ObjectPool&) = delete;
 	ObjectPool& operator=(ObjectPool&&) = delete;
 
-	void init(uint32_t max_obj, uint32_t prefault = 1)
+	// max_obj only reserves address space, memory is committed for the first prefault objects and then on demand
+	void init(uint32_t max_obj = default_reserved_objects, uint32_t prefault = 1)
 	{
-		max_objects = max_obj;
-		map_length = max_objects * sizeof(InternalObject);
-		const uint32_t pf_size = ((prefault * sizeof(InternalObject)) + 4096u) / 4096u;
-		[[maybe_unused]] const uint32_t pf_objects = std::min<uint32_t>(pf_size * 4096u / sizeof(InternalObject), max_objects);
+		max_objects = std::min(max_obj, live_marker - 1);
+		num_chunks = (max_objects + chunk_objects - 1) / chunk_objects;
+		map_length = num_chunks * chunk_bytes;
 
 		#if defined LUMINA_PLATFORM_POSIX
-		objects = reinterpret_cast<InternalObject*>(mmap(nullptr, map_length, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0));
+		objects = reinterpret_cast<InternalObject*>(mmap(nullptr, map_length, PROT_NONE, MAP_ANON | MAP_PRIVATE | MAP_NORESERVE, -1, 0));
 		if(objects == MAP_FAILED)
 			log::critical("object_pool[{}]: mmap {} bytes failed with error {}", name, map_length, std::strerror(errno));
 		#elif defined LUMINA_PLATFORM_WIN32
 		objects = reinterpret_cast<InternalObject*>(VirtualAlloc(nullptr, map_length, MEM_RESERVE, PAGE_NOACCESS));
-		VirtualAlloc(objects, prefault * sizeof(InternalObject), MEM_COMMIT, PAGE_READWRITE);
-		num_allocations = pf_objects;
+		if(!objects)
+			log::critical("object_pool[{}]: reserving {} bytes failed with error {}", name, map_length, GetLastError());
 		#else
 		static_assert(false, "no mmap equivalent for current platform");
 		#endif
 
+		released_chunks.clear();
+		num_released = 0u;
+
+		if(prefault != 0)
+			ensure_committed(0u, std::min(prefault, max_objects));
+
 		monotonic_ctr = 0u;
 		xchg_aba_tag = 0u;
 		freelist_head = invalid_object;
+
+		// one cache per compute thread id, a pool set up before job::init sizes them for the hardware threads.
+		// threads can hold at most two magazines each, keep that below half the pool so caching never starves other threads
+		cache_count = std::max(job::get_thread_count(), std::thread::hardware_concurrency() + 1);
+		magazine_size = std::min(max_magazine_size, max_objects / (4 * cache_count));
+		if(magazine_size == 0)
+			cache_count = 0;
+
+		caches = std::make_unique<ThreadCache[]>(cache_count);
 	}
 
 	template <typename... Args>
 	handle_type allocate(Args&&... args)
 	{
-		for(;;)
+		ThreadCache* cache = thread_cache();
+		if(!cache)
+			return allocate_shared(std::forward<Args>(args)...);
+
+		if(cache->count == 0)
+			cache->count = refill(cache->slots.data(), magazine_size);
+
+		if(cache->count == 0)
 		{
-			uint64_t tag_fh = freelist_head.load(std::memory_order_acquire);
-			uint32_t fhead = tag_fh & 0xFFFFFFFF;
-			if(fhead == invalid_object)
-			{
-				fhead = monotonic_ctr.fetch_add(1, std::memory_order_relaxed);
-				if(fhead >= max_objects)
-				{
-					log::critical("object_pool[{}]: out of handles", name);
-					return handle_type{invalid_object};
-				}
-
-				return internal_allocate(fhead, std::forward<Args>(args)...);
-			}
+			log::critical("object_pool[{}]: out of handles", name);
+			return handle_type{invalid_object};
+		}
 
-			uint32_t next = get_internal(fhead).next.load(std::memory_order_acquire);
-			uint64_t new_freelist_head = (static_cast<uint64_t>(xchg_aba_tag.fetch_add(1, std::memory_order_relaxed)) << 32u) | next;
+		return internal_allocate(cache->slots[--cache->count], std::forward<Args>(args)...);
+	}
 
-			if(freelist_head.compare_exchange_weak(tag_fh, new_freelist_head, std::memory_order_release))
-				return internal_allocate(fhead, std::forward<Args>(args)...);
+	// handle carrying the slot generation, see generation_layout for the 32 and 64 bit packing
+	template <typename H = generational_handle_type, typename... Args>
+	H allocate_generational(Args&&... args)
+	{
+		using layout = generation_layout<typename H::value_type>;
+
+		const handle_type handle = allocate(std::forward<Args>(args)...);
+		if(handle == invalid_object)
+			return H{~typename H::value_type{0}};
+
+		if(handle > layout::index_mask)
+		{
+			log::critical("object_pool[{}]: slot {} does not fit a {} bit generational handle", name, static_cast<uint32_t>(handle), sizeof(H) * 8);
+			return H{~typename H::value_type{0}};
 		}
+
+		return H{layout::pack(handle, get_internal(handle).generation)};
 	}
 
 	void deallocate(handle_type handle) noexcept
 	{
 		InternalObject& obj = get_internal(handle);
 		obj.data.~T();
+		obj.next.store(invalid_object, std::memory_order_relaxed);
+		obj.generation++;
 
-		for(;;)
+		ThreadCache* cache = thread_cache();
+		if(!cache)
 		{
-			uint64_t tag_fh = freelist_head.load(std::memory_order_acquire);
-			uint32_t fhead = tag_fh & 0xFFFFFFFF;
-			
-			obj.next.store(fhead, std::memory_order_release);
-			
-			uint64_t new_freelist_head = (static_cast<uint64_t>(xchg_aba_tag.fetch_add(1u, std::memory_order_relaxed)) << 32u) | handle;
-			if(freelist_head.compare_exchange_weak(tag_fh, new_freelist_head, std::memory_order_release))
-			{
-				return;
-			}
+			push_free(handle, handle);
+			return;
 		}
+
+		if(cache->count == 2 * magazine_size)
+			flush(*cache);
+
+		cache->slots[cache->count++] = handle;
 	}
 
 	constexpr T& get(handle_type handle) noexcept
@@ -134,41 +189,408 @@ public:
 	{
 		return objects[handle].data;
 	}
+
+	template <typename S>
+	void deallocate(StronglyTyped<S, generational_handle_tag<T>> handle) noexcept
+	{
+		validate(handle);
+		deallocate(handle_type{generation_layout<S>::index(handle)});
+	}
+
+	// generations are only compared in debug builds, release builds mask off the index and load
+	template <typename S>
+	constexpr T& get(StronglyTyped<S, generational_handle_tag<T>> handle) noexcept
+	{
+		validate(handle);
+		return objects[generation_layout<S>::index(handle)].data;
+	}
+
+	template <typename S>
+	constexpr const T& get(StronglyTyped<S, generational_handle_tag<T>> handle) const noexcept
+	{
+		validate(handle);
+		return objects[generation_layout<S>::index(handle)].data;
+	}
+
+	template <typename S>
+	[[nodiscard]] bool is_valid(StronglyTyped<S, generational_handle_tag<T>> handle) const noexcept
+	{
+		using layout = generation_layout<S>;
+
+		const uint32_t index = layout::index(handle);
+		if(index >= std::min(monotonic_ctr.load(std::memory_order_relaxed), max_objects) || !is_live(handle_type{index}))
+			return false;
+
+		return (objects[index].generation & layout::generation_mask) == layout::generation(handle);
+	}
+
+	// bumped every time the slot is freed, for handle types that pack their own generation bits
+	[[nodiscard]] uint32_t generation(handle_type handle) const noexcept
+	{
+		return objects[handle].generation;
+	}
+
+	// true while the slot holds an object, does not detect a slot that was freed and allocated again
+	[[nodiscard]] bool is_live(handle_type handle) const noexcept
+	{
+		return handle < max_objects && chunk_state(handle / chunk_objects, std::memory_order_relaxed) == ChunkState::Committed
+			&& objects[handle].next.load(std::memory_order_relaxed) == live_marker;
+	}
+
+	// visits live objects in index order, chunk by chunk. Must not run concurrently with allocate or deallocate
+	template <typename Fn>
+	void for_each(Fn&& fn)
+	{
+		const uint32_t used = std::min(monotonic_ctr.load(std::memory_order_acquire), max_objects);
+		for(uint32_t c = 0; c * chunk_objects < used; c++)
+		{
+			if(chunk_state(c, std::memory_order_acquire) != ChunkState::Committed)
+				continue;
+
+			const uint32_t end = std::min(used, (c + 1) * chunk_objects);
+			for(uint32_t i = c * chunk_objects; i < end; i++)
+			{
+				if(objects[i].next.load(std::memory_order_relaxed) == live_marker)
+					fn(handle_type{i}, objects[i].data);
+			}
+		}
+	}
+
+	// returns the memory of chunks without live objects to the os, released chunks are reused before the pool grows again.
+	// Must not run concurrently with allocate or deallocate, drains the per thread caches
+	void trim()
+	{
+		std::scoped_lock<std::mutex> lock{chunk_mutex};
+
+		// scratch buffers are kept between calls, trimming every few frames does not allocate once they have grown
+		std::vector<uint32_t>& free_slots = trim_free_slots;
+		free_slots.clear();
+		for(uint32_t i = 0; i < cache_count; i++)
+		{
+			free_slots.insert(free_slots.end(), caches[i].slots.begin(), caches[i].slots.begin() + caches[i].count);
+			caches[i].count = 0;
+		}
+
+		for(uint32_t s = freelist_head.load(std::memory_order_acquire) & 0xFFFFFFFF; s != invalid_object; s = get_internal(s).next.load(std::memory_order_relaxed))
+			free_slots.push_back(s);
+
+		const uint32_t used = std::min(monotonic_ctr.load(std::memory_order_acquire), max_objects);
+		const uint32_t used_chunks = (used + chunk_objects - 1) / chunk_objects;
+
+		std::vector<uint32_t>& free_per_chunk = trim_free_per_chunk;
+		free_per_chunk.assign(used_chunks, 0u);
+		for(uint32_t s : free_slots)
+			free_per_chunk[s / chunk_objects]++;
+
+		uint32_t released = 0;
+		for(uint32_t c = 0; c < used_chunks; c++)
+		{
+			if(free_per_chunk[c] != chunk_objects)
+				continue;
+
+			decommit_chunk(c);
+			released_chunks.push_back(c);
+			released++;
+		}
+
+		std::erase_if(free_slots, [this](uint32_t s)
+		{
+			return chunk_state(s / chunk_objects, std::memory_order_relaxed) != ChunkState::Committed;
+		});
+
+		uint64_t new_freelist_head = (static_cast<uint64_t>(xchg_aba_tag.fetch_add(1u, std::memory_order_relaxed)) << 32u) | invalid_object;
+		if(!free_slots.empty())
+		{
+			for(size_t i = 0; i + 1 < free_slots.size(); i++)
+				get_internal(free_slots[i]).next.store(free_slots[i + 1], std::memory_order_relaxed);
+
+			get_internal(free_slots.back()).next.store(invalid_object, std::memory_order_relaxed);
+			new_freelist_head = (new_freelist_head & ~0xFFFFFFFFull) | free_slots.front();
+		}
+
+		freelist_head.store(new_freelist_head, std::memory_order_release);
+		num_released.store(static_cast<uint32_t>(released_chunks.size()), std::memory_order_release);
+
+		if(released != 0)
+		{
+			auto [rs, ru] = log::pretty_format_size(released * chunk_bytes);
+			log::info("object_pool[{}]: released {} chunks ({:.2f} {})", name, released, rs, ru);
+		}
+	}
 private:
+	// written to InternalObject::next while the slot holds a live object, distinct from any index and from zeroed memory
+	constexpr static uint32_t live_marker = 0xFFFFFFFE;
+
+	enum class ChunkState : uint8_t
+	{
+		Reserved,
+		Committed,
+		Released
+	};
+
+	struct ChunkInfo
+	{
+		std::atomic<ChunkState> state{ChunkState::Reserved};
+		// generation the slots resume at when a released chunk is committed again
+		uint32_t generation{0};
+	};
+
+	// chunk bookkeeping grows with the committed range instead of the reservation, segment s holds
+	// chunk_segment_base << s chunks so a fixed table of segments covers any pool size
+	constexpr static uint32_t chunk_segment_base = 16u;
+	constexpr static uint32_t max_chunk_segments = 32u;
+
+	constexpr static std::pair<uint32_t, uint32_t> locate_chunk(uint32_t c) noexcept
+	{
+		const uint32_t segment = static_cast<uint32_t>(std::bit_width(c / chunk_segment_base + 1u)) - 1u;
+		return {segment, c - chunk_segment_base * ((1u << segment) - 1u)};
+	}
+
+	// chunks without a segment yet were never committed
+	ChunkState chunk_state(uint32_t c, std::memory_order order) const noexcept
+	{
+		const auto [segment, offset] = locate_chunk(c);
+		const ChunkInfo* infos = chunk_segments[segment].load(std::memory_order_acquire);
+		return infos ? infos[offset].state.load(order) : ChunkState::Reserved;
+	}
+
+	// allocates the segment on first use, callers hold chunk_mutex
+	ChunkInfo& chunk_info(uint32_t c)
+	{
+		const auto [segment, offset] = locate_chunk(c);
+		ChunkInfo* infos = chunk_segments[segment].load(std::memory_order_relaxed);
+		if(!infos)
+		{
+			infos = new ChunkInfo[chunk_segment_base << segment];
+			chunk_segments[segment].store(infos, std::memory_order_release);
+		}
+
+		return infos[offset];
+	}
+
 	constexpr InternalObject& get_internal(uint32_t handle) noexcept
 	{
 		return objects[handle];
 	}
 
+	template <typename S>
+	void validate([[maybe_unused]] StronglyTyped<S, generational_handle_tag<T>> handle) const noexcept
+	{
+		#if !defined NDEBUG
+		if(!is_valid(handle))
+		{
+			using layout = generation_layout<S>;
+			log::critical("object_pool[{}]: stale handle for slot {} with generation {}, slot is at generation {}", name, layout::index(handle), layout::generation(handle), objects[layout::index(handle)].generation & layout::generation_mask);
+			assert(false && "object_pool: stale generational handle");
+		}
+		#endif
+	}
+
+	// threads without a job system id (or beyond the cached range) go straight to the shared free list
+	ThreadCache* thread_cache() noexcept
+	{
+		const uint32_t id = job::get_thread_id();
+		return id < cache_count ? &caches[id] : nullptr;
+	}
+
 	template <typename... Args>
-	handle_type internal_allocate(uint32_t index, Args&&... args)
+	handle_type allocate_shared(Args&&... args)
+	{
+		uint32_t index;
+		if(refill(&index, 1) == 0)
+		{
+			log::critical("object_pool[{}]: out of handles", name);
+			return handle_type{invalid_object};
+		}
+
+		return internal_allocate(index, std::forward<Args>(args)...);
+	}
+
+	// takes up to n slots from the free list, then from released chunks and only then grows into fresh slots
+	uint32_t refill(uint32_t* out, uint32_t n)
+	{
+		for(;;)
+		{
+			const uint32_t popped = pop_free(out, n);
+			if(popped != 0)
+				return popped;
+
+			if(num_released.load(std::memory_order_acquire) == 0 || !reclaim_chunk())
+				break;
+		}
+
+		const uint32_t first = monotonic_ctr.fetch_add(n, std::memory_order_relaxed);
+		if(first >= max_objects)
+			return 0;
+
+		const uint32_t count = std::min(n, max_objects - first);
+		ensure_committed(first, count);
+
+		// reversed so the cache hands out ascending indices
+		for(uint32_t i = 0; i < count; i++)
+			out[i] = first + count - 1 - i;
+
+		return count;
+	}
+
+	// unlinks up to n entries with a single CAS, the walked chain is only trusted if the tagged head is unchanged
+	uint32_t pop_free(uint32_t* out, uint32_t n) noexcept
 	{
-		//FIXME: test on win32
-		#if defined LUMINA_PLATFORM_WIN32
-		num_allocations = std::max(num_allocations.load(), index + 1);
-		VirtualAlloc(objects, sizeof(InternalObject) * num_allocations, MEM_COMMIT, PAGE_READWRITE);
+		for(;;)
+		{
+			uint64_t tag_fh = freelist_head.load(std::memory_order_acquire);
+			uint32_t next = tag_fh & 0xFFFFFFFF;
+
+			uint32_t count = 0;
+			while(next < max_objects && count < n)
+			{
+				out[count++] = next;
+				next = get_internal(next).next.load(std::memory_order_acquire);
+			}
+
+			if(count == 0)
+				return 0;
+
+			uint64_t new_freelist_head = (static_cast<uint64_t>(xchg_aba_tag.fetch_add(1, std::memory_order_relaxed)) << 32u) | next;
+			if(freelist_head.compare_exchange_weak(tag_fh, new_freelist_head, std::memory_order_release))
+				return count;
+		}
+	}
+
+	// pushes an already linked chain first -> ... -> last
+	void push_free(uint32_t first, uint32_t last) noexcept
+	{
+		InternalObject& tail = get_internal(last);
+		for(;;)
+		{
+			uint64_t tag_fh = freelist_head.load(std::memory_order_acquire);
+			uint32_t fhead = tag_fh & 0xFFFFFFFF;
+
+			tail.next.store(fhead, std::memory_order_release);
+
+			uint64_t new_freelist_head = (static_cast<uint64_t>(xchg_aba_tag.fetch_add(1u, std::memory_order_relaxed)) << 32u) | first;
+			if(freelist_head.compare_exchange_weak(tag_fh, new_freelist_head, std::memory_order_release))
+				return;
+		}
+	}
+
+	// returns the oldest magazine to the shared list and keeps the most recently freed (cache hot) slots
+	void flush(ThreadCache& cache) noexcept
+	{
+		for(uint32_t i = 0; i + 1 < magazine_size; i++)
+			get_internal(cache.slots[i]).next.store(cache.slots[i + 1], std::memory_order_relaxed);
+
+		push_free(cache.slots[0], cache.slots[magazine_size - 1]);
+
+		std::copy(cache.slots.begin() + magazine_size, cache.slots.begin() + cache.count, cache.slots.begin());
+		cache.count -= magazine_size;
+	}
+
+	void ensure_committed(uint32_t first, uint32_t count)
+	{
+		const uint32_t last_chunk = (first + count - 1) / chunk_objects;
+		for(uint32_t c = first / chunk_objects; c <= last_chunk; c++)
+		{
+			if(chunk_state(c, std::memory_order_acquire) == ChunkState::Committed)
+				continue;
+
+			std::scoped_lock<std::mutex> lock{chunk_mutex};
+			if(chunk_state(c, std::memory_order_relaxed) != ChunkState::Committed)
+				commit_chunk(c);
+		}
+	}
+
+	// moves one released chunk back onto the free list, false if another thread took the last one first
+	bool reclaim_chunk()
+	{
+		std::scoped_lock<std::mutex> lock{chunk_mutex};
+		if(released_chunks.empty())
+			return false;
+
+		const uint32_t c = released_chunks.back();
+		released_chunks.pop_back();
+		num_released.store(static_cast<uint32_t>(released_chunks.size()), std::memory_order_release);
+		commit_chunk(c);
+
+		const uint32_t first = c * chunk_objects;
+		const uint32_t last = first + chunk_objects - 1;
+		for(uint32_t i = first; i <= last; i++)
+			get_internal(i).generation = chunk_info(c).generation;
+
+		for(uint32_t i = first; i < last; i++)
+			get_internal(i).next.store(i + 1, std::memory_order_relaxed);
+
+		push_free(first, last);
+		return true;
+	}
+
+	void commit_chunk(uint32_t c)
+	{
+		std::byte* base = reinterpret_cast<std::byte*>(objects) + c * chunk_bytes;
+
+		#if defined LUMINA_PLATFORM_POSIX
+		if(mprotect(base, chunk_bytes, PROT_READ | PROT_WRITE) != 0)
+			log::critical("object_pool[{}]: committing chunk {} failed with error {}", name, c, std::strerror(errno));
+		#elif defined LUMINA_PLATFORM_WIN32
+		if(!VirtualAlloc(base, chunk_bytes, MEM_COMMIT, PAGE_READWRITE))
+			log::critical("object_pool[{}]: committing chunk {} failed with error {}", name, c, GetLastError());
+		#endif
+
+		chunk_info(c).state.store(ChunkState::Committed, std::memory_order_release);
+	}
+
+	// slots come back zeroed, remember where their generations were so handles from before the release stay stale
+	void decommit_chunk(uint32_t c)
+	{
+		uint32_t generation = 0;
+		for(uint32_t i = c * chunk_objects; i < (c + 1) * chunk_objects; i++)
+			generation = std::max(generation, get_internal(i).generation);
+
+		ChunkInfo& info = chunk_info(c);
+		info.generation = generation + 1;
+
+		std::byte* base = reinterpret_cast<std::byte*>(objects) + c * chunk_bytes;
+
+		#if defined LUMINA_PLATFORM_POSIX
+		madvise(base, chunk_bytes, MADV_DONTNEED);
+		mprotect(base, chunk_bytes, PROT_NONE);
+		#elif defined LUMINA_PLATFORM_WIN32
+		VirtualFree(base, chunk_bytes, MEM_DECOMMIT);
 		#endif
 
+		info.state.store(ChunkState::Released, std::memory_order_release);
+	}
+
+	template <typename... Args>
+	handle_type internal_allocate(uint32_t index, Args&&... args)
+	{
 		InternalObject& obj = get_internal(index);
 		::new (&obj.data) T(std::forward<Args>(args)...);
-		obj.next.store(index, std::memory_order_release);
+		obj.next.store(live_marker, std::memory_order_release);
 		return handle_type{index};
 	}
 
 	std::string_view name;
-	
+
 	InternalObject* objects;
 	uint32_t max_objects;
+	uint32_t num_chunks;
 	size_t map_length;
 
-	#if defined LUMINA_PLATFORM_WIN32
-	std::atomic<uint32_t> num_allocations;
-	#endif
+	std::mutex chunk_mutex;
+	std::array<std::atomic<ChunkInfo*>, max_chunk_segments> chunk_segments{};
+	std::vector<uint32_t> released_chunks;
+	std::atomic<uint32_t> num_released;
+	std::vector<uint32_t> trim_free_slots;
+	std::vector<uint32_t> trim_free_per_chunk;
 
 	std::atomic<uint32_t> monotonic_ctr;
 	std::atomic<uint32_t> xchg_aba_tag;
 	std::atomic<uint64_t> freelist_head;
+
+	uint32_t cache_count = 0;
+	uint32_t magazine_size = 0;
+	std::unique_ptr<ThreadCache[]> caches;
 };
 
 }
-
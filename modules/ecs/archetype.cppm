@@ -0,0 +1,595 @@
+export module lumina.ecs:archetype;
+
+import :entity;
+
+import lumina.core;
+import std;
+
+export namespace lumina::ecs
+{
+
+using hash_type = std::uint32_t;
+
+template <typename T>
+constexpr hash_type component_type() noexcept
+{
+	return static_cast<hash_type>(type_hash<T>::get());
+}
+
+// type erased operations an archetype needs to move components between rows
+struct component_info
+{
+	hash_type type;
+	std::size_t size;
+	std::size_t alignment;
+	void (*move_construct)(void* dst, void* src);
+	void (*destroy)(void* ptr);
+
+	template <typename T>
+	static component_info of() noexcept
+	{
+		return
+		{
+			component_type<T>(),
+			sizeof(T),
+			alignof(T),
+			[](void* dst, void* src) { ::new (dst) T(std::move(*static_cast<T*>(src))); },
+			[](void* ptr) { static_cast<T*>(ptr)->~T(); }
+		};
+	}
+};
+
+// all entities with exactly the same component set, rows are spread over fixed size chunks
+// that hold the entity array followed by one tightly packed column per component
+class archetype
+{
+public:
+	static constexpr std::size_t chunk_size = 16384;
+
+	explicit archetype(std::vector<component_info> components) : infos{std::move(components)}
+	{
+		std::ranges::sort(infos, {}, &component_info::type);
+		for(const auto& info : infos)
+			types.push_back(info.type);
+
+		std::size_t row_size = sizeof(entity);
+		for(const auto& info : infos)
+			row_size += info.size;
+
+		offsets.resize(infos.size());
+		for(capacity = static_cast<std::uint32_t>(chunk_size / row_size); capacity > 0; capacity--)
+		{
+			std::size_t end = sizeof(entity) * capacity;
+			for(std::size_t i = 0; i < infos.size(); i++)
+			{
+				offsets[i] = (end + infos[i].alignment - 1) & ~(infos[i].alignment - 1);
+				end = offsets[i] + infos[i].size * capacity;
+			}
+
+			if(end <= chunk_size)
+				break;
+		}
+
+		if(capacity == 0)
+			log::critical("ecs: archetype with {} components does not fit a single row into a {} byte chunk", infos.size(), chunk_size);
+	}
+
+	~archetype()
+	{
+		for(std::uint32_t row = 0; row < count; row++)
+		{
+			for(std::size_t c = 0; c < infos.size(); c++)
+				infos[c].destroy(component(c, row));
+		}
+	}
+
+	archetype(const archetype&) = delete;
+	archetype& operator=(const archetype&) = delete;
+
+	[[nodiscard]] std::span<const component_info> components() const noexcept
+	{
+		return infos;
+	}
+
+	[[nodiscard]] std::span<const hash_type> signature() const noexcept
+	{
+		return types;
+	}
+
+	[[nodiscard]] std::uint32_t size() const noexcept
+	{
+		return count;
+	}
+
+	[[nodiscard]] std::uint32_t rows_per_chunk() const noexcept
+	{
+		return capacity;
+	}
+
+	[[nodiscard]] std::size_t num_chunks() const noexcept
+	{
+		return (count + capacity - 1) / capacity;
+	}
+
+	[[nodiscard]] std::uint32_t rows_in_chunk(std::size_t chunk) const noexcept
+	{
+		return std::min<std::uint32_t>(capacity, count - static_cast<std::uint32_t>(chunk) * capacity);
+	}
+
+	// column of the component or -1 when the archetype does not have it
+	[[nodiscard]] std::int32_t column_of(hash_type type) const noexcept
+	{
+		const auto it = std::ranges::lower_bound(types, type);
+		return (it != types.end() && *it == type) ? static_cast<std::int32_t>(it - types.begin()) : -1;
+	}
+
+	[[nodiscard]] entity* entities(std::size_t chunk) noexcept
+	{
+		return reinterpret_cast<entity*>(chunks[chunk]->bytes.data());
+	}
+
+	[[nodiscard]] entity entity_at(std::uint32_t row) const noexcept
+	{
+		return reinterpret_cast<const entity*>(chunks[row / capacity]->bytes.data())[row % capacity];
+	}
+
+	template <typename T>
+	[[nodiscard]] T* column(std::size_t col, std::size_t chunk) noexcept
+	{
+		return std::launder(reinterpret_cast<T*>(chunks[chunk]->bytes.data() + offsets[col]));
+	}
+
+	[[nodiscard]] void* component(std::size_t col, std::uint32_t row) noexcept
+	{
+		return chunks[row / capacity]->bytes.data() + offsets[col] + (row % capacity) * infos[col].size;
+	}
+
+	// appends a row for ent, the caller constructs every column of it
+	std::uint32_t push(entity ent)
+	{
+		if(count == chunks.size() * capacity)
+		{
+			chunks.push_back(std::make_unique_for_overwrite<chunk>());
+			ticks.resize(ticks.size() + infos.size(), 0u);
+		}
+
+		const std::uint32_t row = count++;
+		::new (entities(row / capacity) + (row % capacity)) entity{ent};
+		return row;
+	}
+
+	// moves the last row into the hole and returns the entity that now lives at row, null if row was the last one.
+	// Components of the removed row must already be destroyed or moved out
+	entity swap_remove(std::uint32_t row)
+	{
+		const std::uint32_t last = --count;
+		if(row == last)
+			return entity{};
+
+		for(std::size_t c = 0; c < infos.size(); c++)
+		{
+			infos[c].move_construct(component(c, row), component(c, last));
+			infos[c].destroy(component(c, last));
+		}
+
+		const entity moved = entity_at(last);
+		entities(row / capacity)[row % capacity] = moved;
+		return moved;
+	}
+
+	// change ticks are kept per chunk and column, a write to any row marks the whole chunk column.
+	// get_mut can run from parallel jobs on rows of the same chunk, so this is an atomic max that only stores once
+	// per chunk and tick
+	void touch(std::size_t col, std::uint32_t row, std::uint32_t tick) noexcept
+	{
+		std::atomic_ref<std::uint32_t> slot{ticks[(row / capacity) * infos.size() + col]};
+		std::uint32_t seen = slot.load(std::memory_order_relaxed);
+		while(seen < tick && !slot.compare_exchange_weak(seen, tick, std::memory_order_relaxed)) {}
+	}
+
+	void touch_row(std::uint32_t row, std::uint32_t tick) noexcept
+	{
+		const std::size_t first = (row / capacity) * infos.size();
+		std::fill_n(ticks.begin() + first, infos.size(), tick);
+	}
+
+	[[nodiscard]] std::uint32_t column_tick(std::size_t col, std::size_t chunk) const noexcept
+	{
+		return ticks[chunk * infos.size() + col];
+	}
+
+	// archetypes reached by adding or removing one component, filled in lazily by the storage
+	std::unordered_map<hash_type, archetype*> add_edges;
+	std::unordered_map<hash_type, archetype*> remove_edges;
+private:
+	struct alignas(64) chunk
+	{
+		std::array<std::byte, chunk_size> bytes;
+	};
+
+	std::vector<component_info> infos;
+	std::vector<hash_type> types;
+	std::vector<std::size_t> offsets;
+	std::uint32_t capacity = 0;
+	std::uint32_t count = 0;
+	std::vector<std::unique_ptr<chunk>> chunks;
+	std::vector<std::uint32_t> ticks;
+};
+
+// archetype backed component storage, adding or removing a component moves the entity's row to another archetype.
+// Iteration walks the chunks of every archetype that has the requested components
+class archetype_storage
+{
+public:
+	explicit archetype_storage(const std::uint32_t* tick_source = nullptr) noexcept : tick{tick_source} {}
+
+	archetype_storage(const archetype_storage&) = delete;
+	archetype_storage& operator=(const archetype_storage&) = delete;
+
+	// forward iterator over one component, walks the column of every chunk in the archetypes that have T.
+	// A single contiguous range can be walked the same way, default constructed iterators mark the end
+	template <typename T>
+	class column_iterator
+	{
+	public:
+		using iterator_concept = std::forward_iterator_tag;
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = T;
+		using difference_type = std::ptrdiff_t;
+		using reference = T&;
+
+		column_iterator() noexcept = default;
+
+		explicit column_iterator(std::span<T> contiguous) noexcept : column{contiguous.data()}, rows{static_cast<std::uint32_t>(contiguous.size())}
+		{
+			if(rows == 0)
+				column = nullptr;
+		}
+
+		explicit column_iterator(archetype_storage& owner) noexcept : storage{&owner}
+		{
+			seek(0, 0);
+		}
+
+		reference operator*() const noexcept
+		{
+			return column[row];
+		}
+
+		column_iterator& operator++() noexcept
+		{
+			if(++row == rows)
+			{
+				if(storage)
+					seek(arch_index, chunk + 1);
+				else
+					*this = column_iterator{};
+			}
+
+			return *this;
+		}
+
+		column_iterator operator++(int) noexcept
+		{
+			column_iterator orig = *this;
+			++(*this);
+			return orig;
+		}
+
+		bool operator==(const column_iterator& rhs) const noexcept
+		{
+			return column == rhs.column && row == rhs.row;
+		}
+	private:
+		// moves to the first non-empty chunk at or after (arch, first_chunk), becomes the end iterator when there is none
+		void seek(std::size_t arch, std::size_t first_chunk) noexcept
+		{
+			for(; arch < storage->archetypes.size(); arch++, first_chunk = 0)
+			{
+				archetype& current = *storage->archetypes[arch];
+				const std::int32_t col = current.column_of(component_type<T>());
+				if(col < 0 || first_chunk >= current.num_chunks())
+					continue;
+
+				arch_index = arch;
+				chunk = first_chunk;
+				column = current.template column<T>(col, chunk);
+				row = 0;
+				rows = current.rows_in_chunk(chunk);
+				return;
+			}
+
+			*this = column_iterator{};
+		}
+
+		archetype_storage* storage = nullptr;
+		std::size_t arch_index = 0;
+		std::size_t chunk = 0;
+		T* column = nullptr;
+		std::uint32_t row = 0;
+		std::uint32_t rows = 0;
+	};
+
+	template <typename T, typename... Args>
+	T* emplace(const entity ent, Args&&... args)
+	{
+		archetype* src = find(ent);
+		if(src && src->column_of(component_type<T>()) >= 0)
+		{
+			T* existing = &get_mut<T>(ent);
+			*existing = T(std::forward<Args>(args)...);
+			return existing;
+		}
+
+		// entities without components follow the add edges of the empty archetype
+		archetype*& dst = (src ? src : empty_archetype())->add_edges[component_type<T>()];
+		if(!dst)
+		{
+			std::vector<component_info> infos;
+			if(src)
+				infos.assign(src->components().begin(), src->components().end());
+
+			infos.push_back(component_info::of<T>());
+			dst = find_or_create(std::move(infos));
+		}
+
+		move_row(ent, src, dst);
+		T* component = static_cast<T*>(dst->component(dst->column_of(component_type<T>()), locations[ent.as_handle()].row));
+		return ::new (component) T(std::forward<Args>(args)...);
+	}
+
+	template <typename T>
+	void remove(const entity ent)
+	{
+		archetype* src = find(ent);
+		if(!src)
+			return;
+
+		const std::int32_t col = src->column_of(component_type<T>());
+		if(col < 0)
+			return;
+
+		archetype*& dst = src->remove_edges[component_type<T>()];
+		if(!dst)
+		{
+			std::vector<component_info> infos;
+			std::ranges::remove_copy_if(src->components(), std::back_inserter(infos), [](const component_info& info)
+			{
+				return info.type == component_type<T>();
+			});
+
+			dst = find_or_create(std::move(infos));
+		}
+
+		src->components()[col].destroy(src->component(col, locations[ent.as_handle()].row));
+		move_row(ent, src, dst);
+	}
+
+	// destroys every component of the entity
+	void erase(const entity ent)
+	{
+		archetype* src = find(ent);
+		if(!src)
+			return;
+
+		const std::uint32_t row = locations[ent.as_handle()].row;
+		for(std::size_t c = 0; c < src->components().size(); c++)
+			src->components()[c].destroy(src->component(c, row));
+
+		release_row(src, row);
+		locations[ent.as_handle()] = {};
+	}
+
+	template <typename T>
+	T& get(const entity ent)
+	{
+		const location& loc = locations[ent.as_handle()];
+		return *static_cast<T*>(loc.arch->component(loc.arch->column_of(component_type<T>()), loc.row));
+	}
+
+	template <typename T>
+	T& get_mut(const entity ent)
+	{
+		const location& loc = locations[ent.as_handle()];
+		const std::int32_t col = loc.arch->column_of(component_type<T>());
+		loc.arch->touch(col, loc.row, current_tick());
+		return *static_cast<T*>(loc.arch->component(col, loc.row));
+	}
+
+	template <typename T>
+	[[nodiscard]] bool contains(const entity ent) const
+	{
+		const archetype* arch = find(ent);
+		return arch && arch->column_of(component_type<T>()) >= 0;
+	}
+
+	template <typename... T, typename Fn>
+	void for_each(Fn& func)
+	{
+		for(const auto& arch : archetypes)
+		{
+			if(arch->size() == 0)
+				continue;
+
+			const std::array<std::int32_t, sizeof...(T)> columns{arch->column_of(component_type<T>())...};
+			if(std::ranges::any_of(columns, [](std::int32_t c) { return c < 0; }))
+				continue;
+
+			for(std::size_t chunk = 0; chunk < arch->num_chunks(); chunk++)
+				for_each_in_chunk<T...>(func, *arch, chunk, columns, std::index_sequence_for<T...>{});
+		}
+	}
+
+	template <typename... T>
+	[[nodiscard]] std::size_t count() const
+	{
+		std::size_t total = 0;
+		for(const auto& arch : archetypes)
+		{
+			if(((arch->column_of(component_type<T>()) >= 0) && ...))
+				total += arch->size();
+		}
+
+		return total;
+	}
+
+	// skips chunks where none of the requested columns were touched at or after since
+	template <typename... T, typename Fn>
+	void for_each_changed(Fn& func, std::uint32_t since)
+	{
+		for(const auto& arch : archetypes)
+		{
+			if(arch->size() == 0)
+				continue;
+
+			const std::array<std::int32_t, sizeof...(T)> columns{arch->column_of(component_type<T>())...};
+			if(std::ranges::any_of(columns, [](std::int32_t c) { return c < 0; }))
+				continue;
+
+			for(std::size_t chunk = 0; chunk < arch->num_chunks(); chunk++)
+			{
+				if(std::ranges::any_of(columns, [&](std::int32_t c) { return arch->column_tick(c, chunk) >= since; }))
+					for_each_in_chunk<T...>(func, *arch, chunk, columns, std::index_sequence_for<T...>{});
+			}
+		}
+	}
+
+	// one job range covers whole chunks, grain is converted from entities to chunks
+	template <typename... T, typename Fn>
+	void par_for_each(Fn& func, std::size_t grain)
+	{
+		struct chunk_ref
+		{
+			archetype* arch;
+			std::size_t chunk;
+			std::array<std::int32_t, sizeof...(T)> columns;
+		};
+
+		std::vector<chunk_ref> work;
+		std::uint32_t rows_per_chunk = 1;
+		for(const auto& arch : archetypes)
+		{
+			if(arch->size() == 0)
+				continue;
+
+			const std::array<std::int32_t, sizeof...(T)> columns{arch->column_of(component_type<T>())...};
+			if(std::ranges::any_of(columns, [](std::int32_t c) { return c < 0; }))
+				continue;
+
+			rows_per_chunk = std::max(rows_per_chunk, arch->rows_per_chunk());
+			for(std::size_t chunk = 0; chunk < arch->num_chunks(); chunk++)
+				work.push_back({arch.get(), chunk, columns});
+		}
+
+		const std::size_t chunk_grain = grain == job::auto_grain ? job::auto_grain : std::max<std::size_t>(1, grain / rows_per_chunk);
+		job::parallel_for(work, chunk_grain, [&func](const chunk_ref& ref)
+		{
+			for_each_in_chunk<T...>(func, *ref.arch, ref.chunk, ref.columns, std::index_sequence_for<T...>{});
+		});
+	}
+private:
+	struct location
+	{
+		archetype* arch = nullptr;
+		std::uint32_t row = 0;
+	};
+
+	template <typename... T, typename Fn, std::size_t... Is>
+	static void for_each_in_chunk(Fn& func, archetype& arch, std::size_t chunk, const std::array<std::int32_t, sizeof...(T)>& columns, std::index_sequence<Is...>)
+	{
+		const std::uint32_t rows = arch.rows_in_chunk(chunk);
+		const entity* ents = arch.entities(chunk);
+		const std::tuple<T*...> cols{arch.template column<T>(columns[Is], chunk)...};
+
+		for(std::uint32_t r = 0; r < rows; r++)
+		{
+			if constexpr(std::is_invocable_v<Fn, ecs::entity, T&...>)
+				func(ents[r], std::get<Is>(cols)[r]...);
+			else
+				func(std::get<Is>(cols)[r]...);
+		}
+	}
+
+	[[nodiscard]] std::uint32_t current_tick() const noexcept
+	{
+		return tick ? *tick : 0u;
+	}
+
+	[[nodiscard]] archetype* find(const entity ent) const noexcept
+	{
+		if(ent.as_handle() >= locations.size())
+			return nullptr;
+
+		const location& loc = locations[ent.as_handle()];
+		return (loc.arch && loc.arch->entity_at(loc.row) == ent) ? loc.arch : nullptr;
+	}
+
+	archetype* find_or_create(std::vector<component_info> infos)
+	{
+		std::vector<hash_type> signature;
+		for(const auto& info : infos)
+			signature.push_back(info.type);
+
+		std::ranges::sort(signature);
+		if(auto it = by_signature.find(signature); it != by_signature.end())
+			return it->second;
+
+		archetype* arch = archetypes.emplace_back(std::make_unique<archetype>(std::move(infos))).get();
+		by_signature.emplace(std::move(signature), arch);
+		return arch;
+	}
+
+	archetype* empty_archetype()
+	{
+		if(!empty)
+			empty = find_or_create({});
+
+		return empty;
+	}
+
+	// moves the components both archetypes share into a new row of dst, the caller handles the rest
+	void move_row(const entity ent, archetype* src, archetype* dst)
+	{
+		if(ent.as_handle() >= locations.size())
+			locations.resize(ent.as_handle() + 1);
+
+		const std::uint32_t row = dst->push(ent);
+		dst->touch_row(row, current_tick());
+		if(src)
+		{
+			const std::uint32_t src_row = locations[ent.as_handle()].row;
+			for(std::size_t c = 0; c < src->components().size(); c++)
+			{
+				const component_info& info = src->components()[c];
+				const std::int32_t dst_col = dst->column_of(info.type);
+				if(dst_col < 0)
+					continue;
+
+				info.move_construct(dst->component(dst_col, row), src->component(c, src_row));
+				info.destroy(src->component(c, src_row));
+			}
+
+			release_row(src, src_row);
+		}
+
+		locations[ent.as_handle()] = {dst, row};
+	}
+
+	void release_row(archetype* arch, std::uint32_t row)
+	{
+		const entity moved = arch->swap_remove(row);
+		if(moved.is_valid())
+		{
+			locations[moved.as_handle()].row = row;
+			arch->touch_row(row, current_tick());
+		}
+	}
+
+	std::vector<std::unique_ptr<archetype>> archetypes;
+	std::map<std::vector<hash_type>, archetype*> by_signature;
+	std::vector<location> locations;
+	archetype* empty = nullptr;
+	const std::uint32_t* tick;
+};
+
+}
@@ -0,0 +1,133 @@
+export module lumina.ecs:group;
+
+import :entity;
+import :archetype;
+import :sparse_set;
+import :pool;
+
+import lumina.core;
+import std;
+
+export namespace lumina::ecs
+{
+
+// owns its pools and keeps every entity that has all of their components packed at the front of each of them,
+// in the same order. Iteration is a lock-step walk over the first size() slots without any contains checks
+template <typename T, typename... Other>
+class group final : public group_base
+{
+public:
+	group(T* fp, Other*... values) : pools{fp, values...}
+	{
+		std::apply([this](auto*... pool)
+		{
+			((pool->owner = this), ...);
+		}, pools);
+
+		// pull in entities that already have every component
+		T* first = std::get<0>(pools);
+		for(std::size_t i = 0; i < first->size(); i++)
+			on_emplace(first->dense_index(static_cast<entity::handle_type>(i)));
+	}
+
+	// archetype backed realms already store matching entities together, the group just forwards to them
+	group(archetype_storage* storage, T* fp, Other*... values) : pools{fp, values...}, archetypes{storage} {}
+
+	~group() override
+	{
+		if(!archetypes)
+		{
+			std::apply([](auto*... pool)
+			{
+				((pool->owner = nullptr), ...);
+			}, pools);
+		}
+	}
+
+	group(const group&) = delete;
+	group& operator=(const group&) = delete;
+
+	[[nodiscard]] std::size_t size() const
+	{
+		if(archetypes)
+			return archetypes->count<typename T::value_type, typename Other::value_type...>();
+
+		return count;
+	}
+
+	template <typename Fn>
+	void for_each(Fn func) const
+	{
+		if(archetypes)
+			archetypes->for_each<typename T::value_type, typename Other::value_type...>(func);
+		else
+			walk(func, 0zu, count, std::index_sequence_for<T, Other...>{});
+	}
+
+	template <typename Fn>
+	void par_for_each(Fn func, std::size_t grain = job::auto_grain) const
+	{
+		if(archetypes)
+		{
+			archetypes->par_for_each<typename T::value_type, typename Other::value_type...>(func, grain);
+			return;
+		}
+
+		job::parallel_for(std::views::iota(0zu, count), grain, [this, &func](std::size_t i)
+		{
+			walk(func, i, i + 1, std::index_sequence_for<T, Other...>{});
+		});
+	}
+
+	void on_emplace(entity ent) override
+	{
+		const bool owned = std::apply([ent](auto*... pool)
+		{
+			return (pool->contains(ent) && ...);
+		}, pools);
+
+		if(!owned || std::get<0>(pools)->packed_index(ent) < count)
+			return;
+
+		std::apply([this, ent](auto*... pool)
+		{
+			(pool->swap_packed(pool->packed_index(ent), static_cast<entity::handle_type>(count)), ...);
+		}, pools);
+
+		count++;
+	}
+
+	void on_erase(entity ent) override
+	{
+		T* first = std::get<0>(pools);
+		if(!first->contains(ent) || first->packed_index(ent) >= count)
+			return;
+
+		count--;
+		std::apply([this, ent](auto*... pool)
+		{
+			(pool->swap_packed(pool->packed_index(ent), static_cast<entity::handle_type>(count)), ...);
+		}, pools);
+	}
+private:
+	template <typename Fn, std::size_t... Is>
+	void walk(Fn& func, std::size_t begin, std::size_t end, std::index_sequence<Is...>) const
+	{
+		const T* first = std::get<0>(pools);
+		const auto components = std::make_tuple(std::get<Is>(pools)->begin()...);
+
+		for(std::size_t i = begin; i < end; i++)
+		{
+			if constexpr(std::is_invocable_v<Fn, ecs::entity, typename T::value_type&, typename Other::value_type&...>)
+				func(first->dense_index(static_cast<entity::handle_type>(i)), std::get<Is>(components)[i]...);
+			else
+				func(std::get<Is>(components)[i]...);
+		}
+	}
+
+	std::tuple<T*, Other*...> pools;
+	std::size_t count = 0;
+	archetype_storage* archetypes = nullptr;
+};
+
+}
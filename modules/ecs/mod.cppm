@@ -1,6 +1,8 @@
 export module lumina.ecs;
 
 export import :entity;
+export import :group;
+export import :pool;
 export import :realm;
 export import :view;
 
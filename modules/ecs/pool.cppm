@@ -10,11 +10,12 @@ export namespace lumina::ecs
 {
 
 template <typename T>
-class component_pool : public sparse_set
+class component_pool final : public sparse_set
 {
 	using component_storage = std::vector<T>;
 public:
 	using base_type = sparse_set;
+	using value_type = T;
 	using iterator = component_storage::iterator;
 	using const_iterator = component_storage::const_iterator;
 
@@ -95,31 +96,132 @@ public:
 		return std::forward_as_tuple(get(ent));
 	}
 
+	// like get, but stamps the component with the current change tick when tracking is enabled
+	T& get_mut(entity ent)
+	{
+		entity::handle_type idx = base_type::packed_index(ent);
+		if(tick_source)
+			ticks[idx] = *tick_source;
+
+		return data[idx];
+	}
+
+	// every component gets a change tick in a vector parallel to data, stamped on emplace and get_mut
+	void track_changes(const std::uint32_t* tick) noexcept
+	{
+		if(!tick_source)
+			ticks.assign(data.size(), *tick);
+
+		tick_source = tick;
+	}
+
+	[[nodiscard]] bool is_tracked() const noexcept
+	{
+		return tick_source != nullptr;
+	}
+
+	// untracked pools never report changes
+	[[nodiscard]] bool changed_since(entity ent, std::uint32_t tick) const noexcept
+	{
+		return tick_source && ticks[base_type::packed_index(ent)] >= tick;
+	}
+
 	template <typename... Args>
 	T* emplace(const entity ent, Args... args)
 	{
 		base_type::push_back(ent);
-		return &data.emplace_back(std::forward<Args>(args)...);
+		T* component = &data.emplace_back(std::forward<Args>(args)...);
+		if(tick_source)
+			ticks.push_back(*tick_source);
+
+		if(!owner)
+			return component;
+
+		owner->on_emplace(ent);
+		return &get(ent);
 	}
 
 	void push_back(entity ent, T comp)
 	{
 		base_type::push_back(ent);
 		data.push_back(comp);
+		if(tick_source)
+			ticks.push_back(*tick_source);
+
+		if(owner)
+			owner->on_emplace(ent);
 	}
 
+	void swap_packed(entity::handle_type lhs, entity::handle_type rhs) noexcept
+	{
+		base_type::swap_packed(lhs, rhs);
+		std::swap(data[lhs], data[rhs]);
+		if(tick_source)
+			std::swap(ticks[lhs], ticks[rhs]);
+	}
+
+	// mirrors the swap and pop in the entity array so both stay in lock step
 	void erase(entity ent) override
 	{
-		auto packed = base_type::operator[](ent);
+		if(owner)
+			owner->on_erase(ent);
+
+		const entity::handle_type packed = base_type::packed_index(ent);
 		base_type::erase(ent);
 
-		data.erase(data.begin() + packed.as_handle());
+		if(packed != data.size() - 1)
+		{
+			data[packed] = std::move(data.back());
+			if(tick_source)
+				ticks[packed] = ticks.back();
+		}
+
+		data.pop_back();
+		if(tick_source)
+			ticks.pop_back();
+	}
+
+	// entities without the component are skipped. The owning group swaps its entities out first, then components
+	// follow the entities the base moves into the holes
+	void erase(std::span<const entity> entities) override
+	{
+		if(owner)
+		{
+			for(const entity ent : entities)
+			{
+				if(contains(ent))
+					owner->on_erase(ent);
+			}
+		}
+
+		const std::size_t end = base_type::erase_batch(entities, [this](entity::handle_type from, entity::handle_type to)
+		{
+			data[to] = std::move(data[from]);
+			if(tick_source)
+				ticks[to] = ticks[from];
+		});
+
+		data.erase(data.begin() + end, data.end());
+		if(tick_source)
+			ticks.resize(end);
 	}
 private:
 	component_storage data;
+	std::vector<std::uint32_t> ticks;
+	const std::uint32_t* tick_source = nullptr;
 };
 
 template <typename T>
 using type_storage = component_pool<T>;
 
+inline std::atomic<std::uint32_t> next_component_index = 0;
+
+// dense index of a component type, assigned once on first use and shared by every realm
+template <typename T>
+std::uint32_t component_index() noexcept
+{
+	static const std::uint32_t index = next_component_index.fetch_add(1, std::memory_order_relaxed);
+	return index;
+}
+
 }
@@ -5,7 +5,10 @@ module;
 export module lumina.ecs:realm;
 
 import :entity;
+import :archetype;
+import :group;
 import :pool;
+import :sparse_set;
 import :view;
 
 import lumina.core;
@@ -14,12 +17,203 @@ import std;
 export namespace lumina::ecs
 {
 
-using hash_type = std::uint32_t;
+// sparse_set keeps one pool per component type, archetype groups entities by their component set so
+// views over components that are always used together become linear scans
+enum class storage_mode
+{
+	sparse_set,
+	archetype
+};
+
+// access declarations for Realm::schedule_system
+template <typename T>
+struct read
+{
+	using type = T;
+	static constexpr bool writes = false;
+};
+
+template <typename T>
+struct write
+{
+	using type = T;
+	static constexpr bool writes = true;
+};
+
+class Realm;
+
+// bump allocator for payloads that must not move once written, blocks are kept and reused after a reset
+class byte_arena
+{
+public:
+	std::byte* allocate(std::size_t size, std::size_t alignment)
+	{
+		for(; active_block < blocks.size(); active_block++, block_top = 0)
+		{
+			block& current = blocks[active_block];
+			void* top = current.data.get() + block_top;
+			std::size_t space = current.size - block_top;
+			if(std::align(alignment, size, top, space))
+			{
+				block_top = current.size - space + size;
+				return static_cast<std::byte*>(top);
+			}
+		}
+
+		const std::size_t bytes = std::max(size + alignment, default_block_size);
+		blocks.push_back({std::make_unique_for_overwrite<std::byte[]>(bytes), bytes});
+		return allocate(size, alignment);
+	}
+
+	// everything allocated so far must already be destroyed
+	void reset() noexcept
+	{
+		active_block = 0;
+		block_top = 0;
+	}
+private:
+	struct block
+	{
+		std::unique_ptr<std::byte[]> data;
+		std::size_t size;
+	};
+
+	static constexpr std::size_t default_block_size = 65536;
+
+	std::vector<block> blocks;
+	std::size_t active_block = 0;
+	std::size_t block_top = 0;
+};
+
+// records structural changes from job threads so they can be applied to the realm later at a sync point.
+// Recording only touches the buffer, spawn reserves a fresh entity handle that is valid right away
+class CommandBuffer
+{
+public:
+	explicit CommandBuffer(Realm& owner) noexcept : realm{&owner} {}
+	~CommandBuffer()
+	{
+		clear();
+	}
+
+	CommandBuffer(const CommandBuffer&) = delete;
+	CommandBuffer& operator=(const CommandBuffer&) = delete;
+
+	CommandBuffer(CommandBuffer&&) noexcept = default;
+	CommandBuffer& operator=(CommandBuffer&&) noexcept = delete;
+
+	ecs::entity spawn();
+
+	void kill(const ecs::entity ent)
+	{
+		commands.push_back({command::op::kill, 0u, ent, nullptr, nullptr, nullptr, nullptr});
+	}
+
+	template <typename T, typename... Args>
+	void emplace(const ecs::entity ent, Args&&... args)
+	{
+		std::byte* payload = arena.allocate(sizeof(T), alignof(T));
+		::new (payload) T(std::forward<Args>(args)...);
+
+		commands.push_back({command::op::emplace, component_type<T>(), ent, payload,
+			&apply_emplace<T>,
+			nullptr,
+			[](std::byte* p) { std::launder(reinterpret_cast<T*>(p))->~T(); }});
+	}
+
+	template <typename T>
+	void remove(const ecs::entity ent)
+	{
+		commands.push_back({command::op::remove, component_type<T>(), ent, nullptr, nullptr, &apply_remove<T>, nullptr});
+	}
+
+	[[nodiscard]] std::size_t size() const noexcept
+	{
+		return commands.size();
+	}
+
+	// drops every recorded command without applying it
+	void clear()
+	{
+		for(const command& c : commands)
+		{
+			if(c.destroy)
+				c.destroy(c.payload);
+		}
+
+		commands.clear();
+		arena.reset();
+	}
+private:
+	friend class Realm;
+
+	struct command
+	{
+		// component changes are applied before kills
+		enum class op : std::uint8_t
+		{
+			emplace,
+			remove,
+			kill
+		};
+
+		op kind;
+		hash_type type;
+		ecs::entity ent;
+		std::byte* payload;
+		void (*emplace)(Realm&, ecs::entity, std::byte*);
+		void (*remove)(Realm&, std::span<const ecs::entity>);
+		void (*destroy)(std::byte*);
+	};
+
+	template <typename T>
+	static void apply_emplace(Realm& realm, ecs::entity ent, std::byte* payload);
+
+	template <typename T>
+	static void apply_remove(Realm& realm, std::span<const ecs::entity> entities);
+
+	Realm* realm;
+	std::vector<command> commands;
+	// payloads never move once recorded, blocks are reused after a flush
+	byte_arena arena;
+};
 
 class Realm
 {
+	struct system_node;
 public:
-	Realm() = default;
+	// refers to a system from schedule_system until the next wait_systems
+	class system_handle
+	{
+	public:
+		system_handle() noexcept = default;
+
+		[[nodiscard]] bool is_finished() const noexcept
+		{
+			return !node || node->done.load(std::memory_order_acquire);
+		}
+	private:
+		friend class Realm;
+
+		explicit system_handle(system_node* n) noexcept : node{n} {}
+
+		system_node* node = nullptr;
+	};
+
+	// one command buffer per compute thread id, a realm created before job::init sizes them for the hardware threads
+	explicit Realm(storage_mode storage = storage_mode::sparse_set) : mode{storage}, archetypes{&tick}
+	{
+		const std::uint32_t buffer_count = std::max(job::get_thread_count(), std::thread::hardware_concurrency() + 1);
+		thread_commands.reserve(buffer_count);
+		for(std::uint32_t i = 0; i < buffer_count; i++)
+			thread_commands.emplace_back(*this);
+	}
+
+	~Realm()
+	{
+		if(!systems.empty())
+			wait_systems();
+	}
 
 	Realm(const Realm&) = delete;
 	Realm& operator=(const Realm&) = delete;
@@ -29,23 +223,61 @@ public:
 
 	ecs::entity spawn()
 	{
-		if(next_entity >= 0xFFFFFF - 1 || next_entity >= max_entities)
+		const ecs::entity::handle_type current = next_entity.load(std::memory_order_relaxed);
+		if(current >= 0xFFFFFF - 1 || current >= max_entities)
 			throw std::runtime_error("ecs: out of entity handles");
 
 		if(entities_to_recycle.empty())
-		{
-			next_entity++;
-			return ecs::entity{next_entity};
-		}
+			return ecs::entity{next_entity.fetch_add(1, std::memory_order_relaxed) + 1};
 
 		ecs::entity recycled = entities_to_recycle.back();
 		entities_to_recycle.pop_back();
 		return recycled;
 	}
 
+	// safe to call from any thread, only hands out fresh handles so it never touches the recycle list
+	ecs::entity reserve_entity()
+	{
+		const ecs::entity::handle_type handle = next_entity.fetch_add(1, std::memory_order_relaxed) + 1;
+		if(handle >= 0xFFFFFF - 1 || handle >= max_entities)
+			throw std::runtime_error("ecs: out of entity handles");
+
+		return ecs::entity{handle};
+	}
+
+	// the command buffer of the calling compute thread, indexed by thread id without locking.
+	// Threads with ids past the buffers, usually dedicated I/O threads, have to record into their own CommandBuffer
+	CommandBuffer& commands()
+	{
+		const std::uint32_t id = job::get_thread_id();
+		if(id >= thread_commands.size())
+			throw std::runtime_error("ecs: per thread command buffers are only available on compute job threads");
+
+		return thread_commands[id];
+	}
+
+	// applies the commands of every job thread in one pass, must not run concurrently with systems that record
+	void flush_commands()
+	{
+		std::vector<CommandBuffer*> buffers;
+		for(auto& buffer : thread_commands)
+			buffers.push_back(&buffer);
+
+		flush(buffers);
+	}
+
+	void flush(CommandBuffer& buffer)
+	{
+		CommandBuffer* single = &buffer;
+		flush({&single, 1});
+	}
+
 	void kill(const ecs::entity ent)
 	{
 		assert(ent.is_valid());
+		if(mode == storage_mode::archetype)
+			archetypes.erase(ent);
+
 		entities_to_recycle.emplace_back(ent.as_handle(), ent.as_version() + 1);
 	}
 
@@ -53,18 +285,76 @@ public:
 	T* emplace(const ecs::entity ent, Args... args)
 	{
 		assert(ent.is_valid());
+		if(mode == storage_mode::archetype)
+			return archetypes.emplace<T>(ent, std::forward<Args>(args)...);
+
 		type_storage<T>* c_pool = ensure_pool<T>();
 		return c_pool->emplace(ent, std::forward<Args>(args)...);
 	}
 
+	template <typename T>
+	void remove(const ecs::entity ent)
+	{
+		assert(ent.is_valid());
+		if(mode == storage_mode::archetype)
+			archetypes.remove<T>(ent);
+		else if(type_storage<T>* c_pool = ensure_pool<T>(); c_pool->contains(ent))
+			c_pool->erase(ent);
+	}
+
+	template <typename T>
+	void remove(std::span<const ecs::entity> entities)
+	{
+		if(mode == storage_mode::archetype)
+		{
+			for(const ecs::entity ent : entities)
+				archetypes.remove<T>(ent);
+		}
+		else
+			ensure_pool<T>()->erase(entities);
+	}
+
 	template <typename T>
 	T& get(const ecs::entity ent)
 	{
 		assert(ent.is_valid());
+		if(mode == storage_mode::archetype)
+			return archetypes.get<T>(ent);
+
 		type_storage<T>* c_pool = ensure_pool<T>();
 		return c_pool->get(ent);
 	}
 
+	// marks the component as changed at the current tick, see track_changes
+	template <typename T>
+	T& get_mut(const ecs::entity ent)
+	{
+		assert(ent.is_valid());
+		if(mode == storage_mode::archetype)
+			return archetypes.get_mut<T>(ent);
+
+		return ensure_pool<T>()->get_mut(ent);
+	}
+
+	// enables change ticks for the pool of T, archetype backed realms always track changes per chunk
+	template <typename T>
+	void track_changes()
+	{
+		ensure_pool<T>()->track_changes(&tick);
+	}
+
+	[[nodiscard]] std::uint32_t current_tick() const noexcept
+	{
+		return tick;
+	}
+
+	// a consumer that calls view.changed_since(last) and then stores last = advance_tick()
+	// sees every change exactly once
+	std::uint32_t advance_tick() noexcept
+	{
+		return ++tick;
+	}
+
 	template <typename T>
 	T* try_get(const ecs::entity ent)
 	{
@@ -77,31 +367,312 @@ public:
 	template <typename... T>
 	ecs::view<type_storage<T>...> view()
 	{
+		if(mode == storage_mode::archetype)
+			return {&archetypes, ensure_pool<T>()...};
+
 		return {ensure_pool<T>()...};
 	}
 
+	// created on first use and kept for the lifetime of the realm, a pool can only be owned by one group
+	template <typename... T>
+	ecs::group<type_storage<T>...>& group()
+	{
+		using group_type = ecs::group<type_storage<T>...>;
+
+		auto& g = groups[component_type<group_type>()];
+		if(g)
+			return *static_cast<group_type*>(g.get());
+
+		if(mode == storage_mode::archetype)
+		{
+			g = std::make_unique<group_type>(&archetypes, ensure_pool<T>()...);
+			return *static_cast<group_type*>(g.get());
+		}
+
+		if(((ensure_pool<T>()->owner != nullptr) || ...))
+		{
+			groups.erase(component_type<group_type>());
+			throw std::runtime_error("ecs: component pool is already owned by another group");
+		}
+
+		g = std::make_unique<group_type>(ensure_pool<T>()...);
+		return *static_cast<group_type*>(g.get());
+	}
+
+	// runs fn as a job once every earlier system with a conflicting access has finished. Systems that only
+	// read the same components run concurrently, a write waits for all earlier readers and writers of that component.
+	// Pools for the declared components are created here so views inside fn never modify the realm.
+	// fn lives in the realm until wait_systems, the job is only scheduled when the last predecessor finishes
+	template <typename... Access, typename Fn>
+	system_handle schedule_system(Fn&& fn, job::Priority priority = job::Priority::Normal)
+	{
+		using callable_type = std::decay_t<Fn>;
+
+		system_node* node;
+		{
+			std::scoped_lock<std::mutex> lock{system_lock};
+			(ensure_pool<typename Access::type>(), ...);
+
+			std::byte* storage = system_arena.allocate(sizeof(callable_type), alignof(callable_type));
+			node = &systems.emplace_back();
+			node->fn = ::new (storage) callable_type(std::forward<Fn>(fn));
+			node->run = [](void* f)
+			{
+				callable_type& callable = *std::launder(static_cast<callable_type*>(f));
+				callable();
+				callable.~callable_type();
+			};
+			node->priority = priority;
+
+			(link_predecessors<Access>(*node), ...);
+			(record_access<Access>(node), ...);
+			systems_running.fetch_add(1u, std::memory_order_relaxed);
+		}
+
+		// drops the count that kept predecessors finishing during linking from starting the system early
+		if(node->pending.fetch_sub(1u, std::memory_order_acq_rel) == 1u)
+			submit_system(*node);
+
+		return system_handle{node};
+	}
+
+	// helps running jobs until the system has finished
+	void wait(system_handle system)
+	{
+		job::wait_until([system]
+		{
+			return system.is_finished();
+		});
+	}
+
+	// waits for every scheduled system and releases their storage, must not run concurrently with schedule_system
+	void wait_systems()
+	{
+		job::wait_until([this]
+		{
+			return systems_running.load(std::memory_order_acquire) == 0u;
+		});
+
+		std::scoped_lock<std::mutex> lock{system_lock};
+		systems.clear();
+		system_accesses.clear();
+		system_arena.reset();
+	}
+
 	template <typename T>
 	bool contains(const ecs::entity ent)
 	{
+		if(mode == storage_mode::archetype)
+			return archetypes.contains<T>(ent);
+
 		type_storage<T>* c_pool = ensure_pool<T>();
 		return c_pool->contains(ent);
 	}
 private:
+	// the common case is a bounds check and two loads, pools are only created on the first use of a type
 	template <typename T>
 	type_storage<T>* ensure_pool()
 	{
-		hash_type type = type_hash<T>::get();
-		if(!c_pools.contains(type))
-			c_pools[type] = std::make_shared<component_pool<T>>();
+		const std::uint32_t index = component_index<T>();
+		if(index < c_pools.size() && c_pools[index]) [[likely]]
+			return static_cast<type_storage<T>*>(c_pools[index].get());
+
+		return create_pool<T>(index);
+	}
+
+	template <typename T>
+	type_storage<T>* create_pool(const std::uint32_t index)
+	{
+		if(index >= c_pools.size())
+			c_pools.resize(index + 1);
+
+		c_pools[index] = std::make_unique<component_pool<T>>();
+		return static_cast<type_storage<T>*>(c_pools[index].get());
+	}
+
+	// commands are sorted so every component type is handled in one run, recording order is kept within a type.
+	// Consecutive removes of the same type go to the pool as a single batch
+	void flush(std::span<CommandBuffer*> buffers)
+	{
+		using command = CommandBuffer::command;
+
+		std::size_t total = 0;
+		for(const CommandBuffer* buffer : buffers)
+			total += buffer->commands.size();
+
+		if(total == 0)
+			return;
+
+		std::vector<command> pending;
+		pending.reserve(total);
+		for(const CommandBuffer* buffer : buffers)
+			pending.insert(pending.end(), buffer->commands.begin(), buffer->commands.end());
+
+		std::ranges::stable_sort(pending, [](const command& lhs, const command& rhs)
+		{
+			return std::pair{lhs.kind == command::op::kill, lhs.type} < std::pair{rhs.kind == command::op::kill, rhs.type};
+		});
+
+		std::vector<ecs::entity> batch;
+		for(std::size_t i = 0; i < pending.size(); i++)
+		{
+			const command& c = pending[i];
+			switch(c.kind)
+			{
+			case command::op::emplace:
+				c.emplace(*this, c.ent, c.payload);
+				break;
+			case command::op::remove:
+				batch.push_back(c.ent);
+				if(i + 1 == pending.size() || pending[i + 1].kind != command::op::remove || pending[i + 1].type != c.type)
+				{
+					c.remove(*this, batch);
+					batch.clear();
+				}
+				break;
+			case command::op::kill:
+				kill(c.ent);
+				break;
+			}
+		}
+
+		// payloads were moved from and destroyed by apply_emplace
+		for(CommandBuffer* buffer : buffers)
+		{
+			buffer->commands.clear();
+			buffer->arena.reset();
+		}
+	}
+
+	struct system_node
+	{
+		void* fn = nullptr;
+		void (*run)(void*) = nullptr;
+		job::Priority priority = job::Priority::Normal;
+		// unfinished predecessors, plus one while schedule_system is still linking them
+		std::atomic<std::uint32_t> pending{1u};
+		std::atomic<bool> done{false};
+		// guarded by system_lock
+		bool finished = false;
+		std::vector<system_node*> successors;
+	};
+
+	struct system_access
+	{
+		system_node* last_write = nullptr;
+		std::vector<system_node*> reads;
+	};
+
+	void submit_system(system_node& node)
+	{
+		job::schedule([this, n = &node]
+		{
+			run_system(*n);
+		}, node.priority);
+	}
+
+	// like job::Graph, a finished system schedules the successors it was the last predecessor of
+	void run_system(system_node& node)
+	{
+		node.run(node.fn);
+
+		std::vector<system_node*> successors;
+		{
+			std::scoped_lock<std::mutex> lock{system_lock};
+			node.finished = true;
+			successors.swap(node.successors);
+		}
+
+		for(system_node* successor : successors)
+		{
+			if(successor->pending.fetch_sub(1u, std::memory_order_acq_rel) == 1u)
+				submit_system(*successor);
+		}
+
+		node.done.store(true, std::memory_order_release);
+		systems_running.fetch_sub(1u, std::memory_order_release);
+	}
+
+	// system_lock is held, finished predecessors are skipped
+	void link(system_node* predecessor, system_node& node)
+	{
+		if(!predecessor || predecessor->finished)
+			return;
+
+		predecessor->successors.push_back(&node);
+		node.pending.fetch_add(1u, std::memory_order_relaxed);
+	}
+
+	template <typename Access>
+	void link_predecessors(system_node& node)
+	{
+		system_access& access = system_accesses[component_type<typename Access::type>()];
+		link(access.last_write, node);
 
-		return reinterpret_cast<type_storage<T>*>(c_pools[type].get());
+		if constexpr(Access::writes)
+		{
+			for(system_node* reader : access.reads)
+				link(reader, node);
+		}
+	}
+
+	template <typename Access>
+	void record_access(system_node* node)
+	{
+		system_access& access = system_accesses[component_type<typename Access::type>()];
+		if constexpr(Access::writes)
+		{
+			access.last_write = node;
+			access.reads.clear();
+		}
+		else
+		{
+			std::erase_if(access.reads, [](const system_node* reader) { return reader->finished; });
+			access.reads.push_back(node);
+		}
 	}
 
 	static constexpr std::size_t max_entities = 65536;
 
-	ecs::entity::handle_type next_entity = 0;
+	storage_mode mode;
+	std::uint32_t tick = 1;
+	archetype_storage archetypes;
+
+	std::mutex system_lock;
+	std::unordered_map<hash_type, system_access> system_accesses;
+	// nodes keep stable addresses, callables are constructed in the arena
+	std::deque<system_node> systems;
+	byte_arena system_arena;
+	std::atomic<std::uint32_t> systems_running = 0;
+
+	std::atomic<ecs::entity::handle_type> next_entity = 0;
 	std::vector<ecs::entity> entities_to_recycle;
-	std::unordered_map<hash_type, std::shared_ptr<component_pool<ecs::entity>::base_type>> c_pools;
+	// indexed by job thread id, sized once in the constructor so handed out references stay valid
+	std::vector<CommandBuffer> thread_commands;
+	// indexed by component_index, null for types this realm has not seen yet
+	std::vector<std::unique_ptr<sparse_set>> c_pools;
+
+	// declared after the pools so groups are destroyed first and can release their ownership
+	std::unordered_map<hash_type, std::unique_ptr<group_base>> groups;
 };
 
+inline ecs::entity CommandBuffer::spawn()
+{
+	return realm->reserve_entity();
+}
+
+template <typename T>
+void CommandBuffer::apply_emplace(Realm& realm, ecs::entity ent, std::byte* payload)
+{
+	T* component = std::launder(reinterpret_cast<T*>(payload));
+	realm.emplace<T>(ent, std::move(*component));
+	component->~T();
+}
+
+template <typename T>
+void CommandBuffer::apply_remove(Realm& realm, std::span<const ecs::entity> entities)
+{
+	realm.remove<T>(entities);
+}
+
 }
@@ -6,20 +6,125 @@ import std;
 export namespace lumina::ecs
 {
 
+// sparse index split into 4k pages that are allocated the first time an entity in their range is added.
+// Untouched ranges all point at one shared page of nulls so lookups never check whether a page exists
+class paged_sparse
+{
+public:
+	static constexpr std::size_t page_entries = 4096 / sizeof(entity::handle_type);
+	static constexpr std::uint32_t page_shift = std::countr_zero(page_entries);
+	static constexpr entity::handle_type page_mask = page_entries - 1;
+	using page_type = std::array<entity::handle_type, page_entries>;
+
+	paged_sparse() = default;
+	paged_sparse(const paged_sparse& other)
+	{
+		*this = other;
+	}
+
+	paged_sparse(paged_sparse&& other) noexcept = default;
+	paged_sparse& operator=(paged_sparse&& other) noexcept = default;
+
+	paged_sparse& operator=(const paged_sparse& other)
+	{
+		if(this == &other)
+			return *this;
+
+		pages.assign(other.pages.size(), &null_page);
+		owned.clear();
+		owned.resize(other.owned.size());
+
+		for(std::size_t i = 0; i < other.owned.size(); i++)
+		{
+			if(other.owned[i])
+			{
+				owned[i] = std::make_unique<page_type>(*other.owned[i]);
+				pages[i] = owned[i].get();
+			}
+		}
+
+		return *this;
+	}
+
+	void swap(paged_sparse& other) noexcept
+	{
+		std::swap(pages, other.pages);
+		std::swap(owned, other.owned);
+	}
+
+	// the page range only grows, so this is the one check a lookup for an unknown entity needs
+	[[nodiscard]] constexpr bool in_range(entity::handle_type handle) const noexcept
+	{
+		return (handle >> page_shift) < pages.size();
+	}
+
+	[[nodiscard]] constexpr entity::handle_type operator[](entity::handle_type handle) const noexcept
+	{
+		return (*pages[handle >> page_shift])[handle & page_mask];
+	}
+
+	entity::handle_type& assure(entity::handle_type handle)
+	{
+		const std::size_t page = handle >> page_shift;
+		if(page >= pages.size())
+		{
+			pages.resize(page + 1, &null_page);
+			owned.resize(page + 1);
+		}
+
+		if(!owned[page])
+		{
+			owned[page] = std::make_unique<page_type>(null_page);
+			pages[page] = owned[page].get();
+		}
+
+		return (*owned[page])[handle & page_mask];
+	}
+
+	// only valid for handles whose page was assured before
+	entity::handle_type& at(entity::handle_type handle) noexcept
+	{
+		return (*owned[handle >> page_shift])[handle & page_mask];
+	}
+private:
+	static constexpr page_type null_page = []
+	{
+		page_type p;
+		p.fill(entity::null);
+		return p;
+	}();
+
+	std::vector<const page_type*> pages;
+	std::vector<std::unique_ptr<page_type>> owned;
+};
+
+// notified by the pools a group owns whenever one of them gains or is about to lose an entity
+struct group_base
+{
+	virtual ~group_base() = default;
+	virtual void on_emplace(entity ent) = 0;
+	virtual void on_erase(entity ent) = 0;
+};
+
 class sparse_set
 {
 	using dense_storage_type = std::vector<entity>;
-	using sparse_storage_type = std::vector<entity::handle_type>;
+	using sparse_storage_type = paged_sparse;
 public:
 	using pointer = dense_storage_type::pointer;
 	using iterator = dense_storage_type::iterator;
 
 	sparse_set() = default;
 	virtual ~sparse_set() = default;
-	sparse_set(const sparse_set& other) noexcept = default;
+	sparse_set(const sparse_set& other) : dense{other.dense}, sparse{other.sparse} {}
 	sparse_set(sparse_set&& other) noexcept : dense{std::move(other.dense)}, sparse{std::move(other.sparse)} {}
 
-	sparse_set& operator=(const sparse_set& other) noexcept = default;
+	sparse_set& operator=(const sparse_set& other)
+	{
+		dense = other.dense;
+		sparse = other.sparse;
+		return *this;
+	}
 
 	sparse_set& operator=(sparse_set&& other) noexcept
 	{
@@ -40,7 +145,7 @@ public:
 
 	void swap(sparse_set& other) noexcept
 	{
-		std::swap(sparse, other.sparse);
+		sparse.swap(other.sparse);
 		std::swap(dense, other.dense);
 	}
 
@@ -59,58 +164,114 @@ public:
 		return dense[sparse[index.as_handle()]];
 	}
 
-	[[nodiscard]] virtual bool empty() const noexcept
+	[[nodiscard]] bool empty() const noexcept
 	{
 		return dense.empty();
 	}
 
-	[[nodiscard]] virtual std::size_t size() const noexcept
+	[[nodiscard]] std::size_t size() const noexcept
 	{
 		return dense.size();
 	}
 
-	[[nodiscard]] virtual std::size_t capacity() const noexcept
+	[[nodiscard]] std::size_t capacity() const noexcept
 	{
 		return dense.capacity();
 	}
 
-	[[nodiscard]] virtual pointer data() noexcept
+	[[nodiscard]] pointer data() noexcept
 	{
 		return dense.data();
 	}
 
-	virtual void push_back(const entity value)
+	void push_back(const entity value)
 	{
 		dense.push_back(value);
+		sparse.assure(value.as_handle()) = dense.size() - 1;
+	}
 
-		if(sparse.size() <= value.as_handle())
-			sparse.resize(value.as_handle() + 1);
-
-		sparse[value.as_handle()] = dense.size() - 1;
+	// exchanges two packed slots, component pools move their components along
+	void swap_packed(entity::handle_type lhs, entity::handle_type rhs) noexcept
+	{
+		std::swap(dense[lhs], dense[rhs]);
+		sparse.at(dense[lhs].as_handle()) = lhs;
+		sparse.at(dense[rhs].as_handle()) = rhs;
 	}
 
+	// the owning group is told about every entity added to or removed from this set, copies are never owned
+	group_base* owner = nullptr;
+
+	// swaps the last entity into the hole, the packed index of everything else is unchanged.
+	// Virtual only so components can be removed through the type erased base, view iteration never calls it
 	virtual void erase(const entity index)
 	{
 		const entity tmp = dense.back();
-		dense[sparse[index.as_handle()]] = tmp;
-		sparse[tmp.as_handle()] = sparse[index.as_handle()];
+		const entity::handle_type packed = sparse[index.as_handle()];
+		dense[packed] = tmp;
+		sparse.at(tmp.as_handle()) = packed;
+		sparse.at(index.as_handle()) = entity::null;
 
 		dense.pop_back();
 	}
 
-	virtual bool contains(const entity ent)
+	// entities that are not in the set are skipped
+	virtual void erase(std::span<const entity> entities)
 	{
-		if(!ent.is_valid())
-			return false;
+		erase_batch(entities, [](entity::handle_type, entity::handle_type) {});
+	}
 
-		if(ent.as_handle() >= sparse.size())
+	[[nodiscard]] bool contains(const entity ent) const noexcept
+	{
+		// null entities fail the dense comparison, dense never holds them
+		if(!sparse.in_range(ent.as_handle()))
 			return false;
 
-		return this->operator[](ent) == ent;
+		const entity::handle_type packed = sparse[ent.as_handle()];
+		return packed < dense.size() && dense[packed] == ent;
+	}
+protected:
+	// unlinks every entity first and leaves a null tombstone in its slot, then fills the holes below the new size
+	// with the last live entities in one pass. relocate(from, to) is called for every moved slot so pools can
+	// mirror it, returns the new size
+	template <typename Relocate>
+	std::size_t erase_batch(std::span<const entity> entities, Relocate&& relocate)
+	{
+		holes.clear();
+		for(const entity ent : entities)
+		{
+			// duplicates fail here once the first copy is unlinked
+			if(!contains(ent))
+				continue;
+
+			const entity::handle_type packed = sparse[ent.as_handle()];
+			sparse.at(ent.as_handle()) = entity::null;
+			dense[packed] = entity{};
+			holes.push_back(packed);
+		}
+
+		std::size_t end = dense.size();
+		for(const entity::handle_type hole : holes)
+		{
+			while(end > 0 && !dense[end - 1].is_valid())
+				end--;
+
+			// holes past the live tail are dropped by the resize
+			if(hole >= end)
+				continue;
+
+			end--;
+			dense[hole] = dense[end];
+			sparse.at(dense[hole].as_handle()) = hole;
+			relocate(static_cast<entity::handle_type>(end), hole);
+		}
+
+		dense.resize(end);
+		return end;
 	}
 private:
 	dense_storage_type dense;
 	sparse_storage_type sparse;
+	std::vector<entity::handle_type> holes;
 };
 
 }
@@ -1,6 +1,7 @@
 export module lumina.ecs:view;
 
 import :entity;
+import :archetype;
 import :pool;
 
 import lumina.core;
@@ -20,11 +21,50 @@ public:
 		select_pool();
 	}
 
+	// archetype backed realms iterate the matching chunks, the pools are only kept for their types
+	view(archetype_storage* storage, T* fv, Other*... values) noexcept : pools{fv, values...}, v{}, archetypes{storage}
+	{
+		select_pool();
+	}
+
 	template <typename Fn>
 	void for_each(Fn func) const
 	{
-		if(v)
-			find_pool_for_each(func, std::index_sequence_for<T, Other...>{});
+		auto all = [](ecs::entity) { return true; };
+		if(archetypes)
+			archetypes->for_each<typename T::value_type, typename Other::value_type...>(func);
+		else if(v)
+			find_pool_for_each(func, all, std::index_sequence_for<T, Other...>{});
+	}
+
+	// visits entities where any tracked component of the view was emplaced or written through get_mut at or after tick.
+	// Archetype backed realms track ticks per chunk and visit every entity of a changed chunk
+	template <typename Fn>
+	void changed_since(std::uint32_t tick, Fn func) const
+	{
+		auto changed = [this, tick](ecs::entity ent)
+		{
+			return std::apply([ent, tick](auto*... pool)
+			{
+				return (pool->changed_since(ent, tick) || ...);
+			}, pools);
+		};
+
+		if(archetypes)
+			archetypes->for_each_changed<typename T::value_type, typename Other::value_type...>(func, tick);
+		else if(v)
+			find_pool_for_each(func, changed, std::index_sequence_for<T, Other...>{});
+	}
+
+	// splits the smallest pool into ranges of grain entities and runs them on the job system, returns once all ran.
+	// func is called concurrently and must only touch the components it is given
+	template <typename Fn>
+	void par_for_each(Fn func, std::size_t grain = job::auto_grain) const
+	{
+		if(archetypes)
+			archetypes->par_for_each<typename T::value_type, typename Other::value_type...>(func, grain);
+		else if(v)
+			find_pool_par_for_each(func, grain, std::index_sequence_for<T, Other...>{});
 	}
 private:
 	void select_pool() noexcept
@@ -62,12 +102,12 @@ private:
 			return std::get<OPool>(pools)->get_as_tuple(std::get<0>(current));
 	}
 
-	template <std::size_t CurIdx, typename Fn, std::size_t... Is>
-	void internal_for_each(Fn& func, std::index_sequence<Is...>) const
+	template <std::size_t CurIdx, typename Fn, typename Filter, std::size_t... Is>
+	void internal_for_each(Fn& func, Filter& filter, std::index_sequence<Is...>) const
 	{
 		for(auto pair : (std::get<CurIdx>(pools)->pair_iterator()))
 		{
-			if(const auto entity = std::get<0>(pair); ((CurIdx == Is || std::get<Is>(pools)->contains(entity)) && ...))
+			if(const auto entity = std::get<0>(pair); ((CurIdx == Is || std::get<Is>(pools)->contains(entity)) && ...) && filter(entity))
 			{
 				if constexpr(is_applicable_v<Fn, decltype(std::tuple_cat(std::tuple<ecs::entity>{}, std::declval<view>().get_as_tuple({})))>)
 					std::apply(func, std::tuple_cat(std::make_tuple(entity), access_pool<CurIdx, Is>(pair)...));
@@ -77,26 +117,58 @@ private:
 		}
 	}
 
+	template <typename Fn, typename Filter, std::size_t... Is>
+	void find_pool_for_each(Fn& func, Filter& filter, std::index_sequence<Is...> idx) const
+	{
+		((std::get<Is>(pools) == v ? internal_for_each<Is>(func, filter, idx) : void()), ...);
+	}
+
+	template <std::size_t CurIdx, typename Fn, std::size_t... Is>
+	void internal_par_for_each(Fn& func, std::size_t grain, std::index_sequence<Is...>) const
+	{
+		auto* pool = std::get<CurIdx>(pools);
+		const auto components = pool->begin();
+
+		job::parallel_for(std::views::iota(0zu, pool->size()), grain, [&](std::size_t i)
+		{
+			const ecs::entity entity = pool->dense_index(static_cast<ecs::entity::handle_type>(i));
+			if(((CurIdx == Is || std::get<Is>(pools)->contains(entity)) && ...))
+			{
+				auto pair = std::tuple_cat(std::make_tuple(entity), std::forward_as_tuple(components[i]));
+				if constexpr(is_applicable_v<Fn, decltype(std::tuple_cat(std::tuple<ecs::entity>{}, std::declval<view>().get_as_tuple({})))>)
+					std::apply(func, std::tuple_cat(std::make_tuple(entity), access_pool<CurIdx, Is>(pair)...));
+				else
+					std::apply(func, std::tuple_cat(access_pool<CurIdx, Is>(pair)...));
+			}
+		});
+	}
+
 	template <typename Fn, std::size_t... Is>
-	void find_pool_for_each(Fn& func, std::index_sequence<Is...> idx) const
+	void find_pool_par_for_each(Fn& func, std::size_t grain, std::index_sequence<Is...> idx) const
 	{
-		((std::get<Is>(pools) == v ? internal_for_each<Is>(func, idx) : void()), ...);
+		((std::get<Is>(pools) == v ? internal_par_for_each<Is>(func, grain, idx) : void()), ...);
 	}
 
 	std::tuple<T*, Other*...> pools;
 	common_type* v;
+	archetype_storage* archetypes = nullptr;
 };
 
 template <typename T>
 class view<T>
 {
 public:
-	using iterator = T::iterator;
+	// sparse set pools are walked as one contiguous range, archetype backed realms chunk by chunk
+	using iterator = archetype_storage::column_iterator<typename T::value_type>;
 
 	view(T* value) noexcept : v{value}
 	{
 	}
 
+	view(archetype_storage* storage, T* value) noexcept : v{value}, archetypes{storage}
+	{
+	}
+
 	[[nodiscard]] explicit operator bool() const noexcept
 	{
 		return (v != nullptr);
@@ -104,18 +176,31 @@ public:
 
 	[[nodiscard]] iterator begin() const noexcept
 	{
-		return v ? v->begin() : iterator{};
+		if(archetypes)
+			return iterator{*archetypes};
+
+		return v ? iterator{std::span{std::to_address(v->begin()), v->size()}} : iterator{};
 	}
 
 	[[nodiscard]] iterator end() const noexcept
 	{
-		return v ? v->end() : iterator{};
+		return iterator{};
 	}
 
 	template <typename Fn>
 	void for_each(Fn func) const
 	{
-		if(v)
+		if(archetypes)
+		{
+			if constexpr(std::is_invocable_v<Fn, ecs::entity, typename T::value_type&> || std::is_invocable_v<Fn, typename T::value_type&>)
+				archetypes->for_each<typename T::value_type>(func);
+			else
+			{
+				auto ignore_component = [&func](typename T::value_type&) { func(); };
+				archetypes->for_each<typename T::value_type>(ignore_component);
+			}
+		}
+		else if(v)
 		{
 			if constexpr(std::is_invocable_v<Fn, ecs::entity, decltype(*v->begin())>)
 			{
@@ -134,8 +219,53 @@ public:
 			}
 		}
 	}
+
+	// splits the pool, or the matching archetype chunks, into ranges of grain entities and runs them on the job system.
+	// Returns once all ran, func is called concurrently
+	template <typename Fn>
+	void par_for_each(Fn func, std::size_t grain = job::auto_grain) const
+	{
+		if(archetypes)
+			archetypes->par_for_each<typename T::value_type>(func, grain);
+		else if(v)
+		{
+			const auto components = v->begin();
+			job::parallel_for(std::views::iota(0zu, v->size()), grain, [&](std::size_t i)
+			{
+				if constexpr(std::is_invocable_v<Fn, ecs::entity, typename T::value_type&>)
+					func(v->dense_index(static_cast<ecs::entity::handle_type>(i)), components[i]);
+				else
+					func(components[i]);
+			});
+		}
+	}
+
+	template <typename Fn>
+	void changed_since(std::uint32_t tick, Fn func) const
+	{
+		if(archetypes)
+		{
+			archetypes->for_each_changed<typename T::value_type>(func, tick);
+			return;
+		}
+
+		if(!v || !v->is_tracked())
+			return;
+
+		for(auto&& pair : v->pair_iterator())
+		{
+			if(!v->changed_since(std::get<0>(pair), tick))
+				continue;
+
+			if constexpr(std::is_invocable_v<Fn, ecs::entity, decltype(*v->begin())>)
+				func(std::get<0>(pair), std::get<1>(pair));
+			else
+				func(std::get<1>(pair));
+		}
+	}
 private:
 	T* v;
+	archetype_storage* archetypes = nullptr;
 };
 
 }
@@ -1,3 +1,7 @@
+module;
+
+#include <cassert>
+
 export module lumina.physics:broadphase_interface;
 
 export import :bvh4_tree;
@@ -11,18 +15,43 @@ import std;
 namespace lumina::physics
 {
 
+// the first layers are reserved, user defined layers start at FirstUser
+export struct BroadphaseLayers
+{
+	constexpr static uint32_t Static = 0u;
+	constexpr static uint32_t Dynamic = 1u;
+	constexpr static uint32_t Kinematic = 2u;
+	constexpr static uint32_t Trigger = 3u;
+	constexpr static uint32_t FirstUser = 4u;
+
+	constexpr static uint32_t max_layers = 32u;
+};
+
 export class BroadphaseInterface
 {
 public:
-	BroadphaseInterface(RigidbodyInterface& rr) : allocator{"bvh4_node_allocator"}
+	// a four wide tree needs about a third of a node per body, this leaves room for well over a million bodies
+	constexpr static uint32_t max_nodes = 1u << 19;
+
+	BroadphaseInterface(RigidbodyInterface& rr, uint32_t layer_count = BroadphaseLayers::FirstUser) : allocator{"bvh4_node_allocator"}, rigidbody_interface{&rr}
 	{
+		assert(layer_count > BroadphaseLayers::Trigger && layer_count <= BroadphaseLayers::max_layers);
+
+		// reserves address space for max_nodes, only the first few chunks are committed up front
 		const uint32_t estimated_max_nodes = 512;
-		allocator.init(2 * estimated_max_nodes, 2 * estimated_max_nodes);
+		allocator.init(max_nodes, 2 * estimated_max_nodes);
 
-		num_layers = 1u;
+		num_layers = layer_count;
 		layers = new BVH4Tree[num_layers];
 		for(uint32_t i = 0; i < num_layers; i++)
 			layers[i].init(&allocator, &rr);
+
+		// static geometry is rebuilt rarely and queried every frame, so it gets the better tree
+		layers[BroadphaseLayers::Static].set_build_strategy(BuildStrategy::SAH);
+
+		// everything collides except static against static
+		layer_masks.fill((num_layers == 32u) ? ~0u : ((1u << num_layers) - 1u));
+		set_layer_collision(BroadphaseLayers::Static, BroadphaseLayers::Static, false);
 	}
 
 	~BroadphaseInterface()
@@ -36,36 +65,107 @@ public:
 	BroadphaseInterface(BroadphaseInterface&&) = delete;
 	BroadphaseInterface& operator=(BroadphaseInterface&&) = delete;
 
-	void request_insert(std::span<Handle<Rigidbody>> rigidbodies)
+	void set_build_strategy(uint32_t layer, BuildStrategy strategy)
+	{
+		assert(layer < num_layers);
+		layers[layer].set_build_strategy(strategy);
+	}
+
+	// the filter matrix is symmetric, a layer tested against itself reports pairs within that layer
+	void set_layer_collision(uint32_t lhs, uint32_t rhs, bool collide)
 	{
-		layers[0].request_insert(rigidbodies);
+		assert(lhs < num_layers && rhs < num_layers);
+
+		if(collide)
+		{
+			layer_masks[lhs] |= (1u << rhs);
+			layer_masks[rhs] |= (1u << lhs);
+		}
+		else
+		{
+			layer_masks[lhs] &= ~(1u << rhs);
+			layer_masks[rhs] &= ~(1u << lhs);
+		}
+	}
+
+	[[nodiscard]] bool layers_collide(uint32_t lhs, uint32_t rhs) const noexcept
+	{
+		return layer_masks[lhs] & (1u << rhs);
+	}
+
+	void request_insert(uint32_t layer, std::span<Handle<Rigidbody>> rigidbodies)
+	{
+		assert(layer < num_layers);
+
+		for(auto body : rigidbodies)
+			rigidbody_interface->get(body).broadphase_layer = layer;
+
+		layers[layer].request_insert(rigidbodies);
 	}
 
 	void signal_body_updates(std::span<Handle<Rigidbody>> rigidbodies)
 	{
-		layers[0].signal_body_updates(rigidbodies);
+		for_each_layer_batch(rigidbodies, [](BVH4Tree& layer, std::span<Handle<Rigidbody>> bodies)
+		{
+			layer.signal_body_updates(bodies);
+		});
 	}
 
 	void remove_bodies(std::span<Handle<Rigidbody>> rigidbodies)
 	{
-		layers[0].remove_bodies(rigidbodies);
+		for_each_layer_batch(rigidbodies, [](BVH4Tree& layer, std::span<Handle<Rigidbody>> bodies)
+		{
+			layer.remove_bodies(bodies);
+		});
 	}
 
-	RaycastResult cast_ray(const Raycast& ray, Handle<Rigidbody> ignore = RigidbodyInterface::invalid_handle)
+	RaycastResult cast_ray(const Raycast& ray, Handle<Rigidbody> ignore = RigidbodyInterface::invalid_handle, uint32_t layer_mask = ~0u)
 	{
-		return layers[0].cast_ray(ray, ignore);
+		RaycastResult res{RigidbodyInterface::invalid_handle, std::numeric_limits<float>::infinity()};
+		for(uint32_t i = 0; i < num_layers; i++)
+		{
+			if(!(layer_mask & (1u << i)))
+				continue;
+
+			const RaycastResult hit = layers[i].cast_ray(ray, ignore);
+			if(hit.body != RigidbodyInterface::invalid_handle && hit.t < res.t)
+				res = hit;
+		}
+
+		return res;
 	}
 
-	void cast_aabb(const AABBCast& cast, std::vector<AABBCastResult>& out, Handle<Rigidbody> ignore = RigidbodyInterface::invalid_handle)
+	void cast_aabb(const AABBCast& cast, std::vector<AABBCastResult>& out, Handle<Rigidbody> ignore = RigidbodyInterface::invalid_handle, uint32_t layer_mask = ~0u)
 	{
-		return layers[0].cast_aabb(cast, out, ignore);
+		for(uint32_t i = 0; i < num_layers; i++)
+		{
+			if(layer_mask & (1u << i))
+				layers[i].cast_aabb(cast, out, ignore);
+		}
 	}
 
-	void collect_colliding_pairs(std::span<Handle<Rigidbody>> bodies, std::vector<RigidbodyPair>& pairs)
+	// pairs of every layer combination enabled in the filter matrix, sorted with r0 < r1
+	void collect_colliding_pairs(std::vector<RigidbodyPair>& pairs)
 	{
-		layers[0].collect_colliding_pairs(bodies, pairs);
+		const std::size_t first_pair = pairs.size();
+
+		for(uint32_t i = 0; i < num_layers; i++)
+		{
+			if(layers_collide(i, i))
+				layers[i].collect_colliding_pairs(pairs);
+
+			for(uint32_t j = i + 1; j < num_layers; j++)
+			{
+				if(layers_collide(i, j))
+					layers[i].collect_colliding_pairs(layers[j], pairs);
+			}
+		}
+
+		// a body only lives in one layer, so merging the per layer results can't produce duplicates
+		std::sort(pairs.begin() + static_cast<std::ptrdiff_t>(first_pair), pairs.end());
 	}
 
+	// only layers that changed since the last update are rebuilt, static layers stay untouched while just dynamic bodies move
 	void ready_update()
 	{
 		for(uint32_t i = 0; i < num_layers; i++)
@@ -81,10 +181,30 @@ public:
 			layers[i].switch_root();
 	}
 private:
+	// splits bodies into runs per layer, the order within a layer is kept. The batches keep their capacity between calls
+	template <typename Fn>
+	void for_each_layer_batch(std::span<Handle<Rigidbody>> rigidbodies, Fn&& fn)
+	{
+		for(uint32_t i = 0; i < num_layers; i++)
+			layer_batches[i].clear();
+
+		for(auto body : rigidbodies)
+			layer_batches[rigidbody_interface->read_body(body).broadphase_layer].push_back(body);
+
+		for(uint32_t i = 0; i < num_layers; i++)
+		{
+			if(!layer_batches[i].empty())
+				fn(layers[i], std::span<Handle<Rigidbody>>{layer_batches[i]});
+		}
+	}
+
 	BVH4Tree::NodeAllocator allocator;
+	RigidbodyInterface* rigidbody_interface{nullptr};
 
 	BVH4Tree* layers{nullptr};
-	uint32_t num_layers{0u};	
+	uint32_t num_layers{0u};
+	std::array<uint32_t, BroadphaseLayers::max_layers> layer_masks{};
+	std::array<std::vector<Handle<Rigidbody>>, BroadphaseLayers::max_layers> layer_batches;
 };
 
-}		
+}
@@ -49,6 +49,13 @@ private:
 	uint32_t handle;
 };
 
+// midpoint is cheap to build, SAH costs more per build but gives tighter trees for clustered bodies
+export enum class BuildStrategy
+{
+	Midpoint,
+	SAH
+};
+
 struct TreeBuildResult
 {
 	BVH4NodeID root;
@@ -61,6 +68,7 @@ struct TreeBuildContext
 	RigidbodyInterface& rr;
 	std::span<BVH4NodeID> nodes;
 	uint32_t force_dirty_level;
+	BuildStrategy strategy;
 };
 
 struct TreeNodeData
@@ -84,135 +92,316 @@ struct TreeBodyInfo
 	vec3 center;
 };
 
-TreeBuildResult build_tree(TreeBuildContext&& ctx)
+struct SAHSplit
 {
-	ZoneScoped;
-	assert(!ctx.nodes.empty());
+	uint32_t axis;
+	uint32_t bin;
+	float origin;
+	float scale;
 
-	auto get_node_bounds = [&ctx](BVH4NodeID id) -> AABB
+	[[nodiscard]] uint32_t bin_of(const AABB& bounds) const noexcept;
+};
+
+constexpr uint32_t sah_bin_count = 12;
+
+uint32_t SAHSplit::bin_of(const AABB& bounds) const noexcept
+{
+	const float c = bounds.get_center()[axis];
+	return std::min(static_cast<uint32_t>(std::max((c - origin) * scale, 0.0f)), sah_bin_count - 1);
+}
+
+// bounds and counts of the bins along every axis
+struct SAHBins
+{
+	std::array<std::array<AABB, sah_bin_count>, 3> bounds;
+	std::array<std::array<uint32_t, sah_bin_count>, 3> counts{};
+
+	SAHBins()
 	{
-		ZoneScoped;
-		if(id.is_body())
-			return ctx.rr.read_body(id.as_body()).get_transformed_bounds();
-	
-		const BVH4Node& n = ctx.alloc.get(id.as_node());
-		AABB bnd = n.get_child_bounds(0);
-		for(uint32_t c = 1; c < 4; c++)
-			bnd = AABB::merge(bnd, n.get_child_bounds(c));
+		for(auto& axis : bounds)
+			axis.fill(AABB{vec3{1e30f}, vec3{-1e30f}});
+	}
+};
 
-		return bnd;
-	};
+// ranges at least this large get their bounds, bins and partition computed on all job threads
+constexpr uint32_t parallel_partition_threshold = 16384;
+// subtrees at least this large are built by their own job
+constexpr uint32_t parallel_subtree_threshold = 1024;
+constexpr std::size_t parallel_build_grain = 4096;
 
-	if(ctx.nodes.size() == 1)
+struct TreeBuildState
+{
+	TreeBuildContext& ctx;
+	std::span<TreeNodeData> node_data;
+	std::span<TreeNodeData> scratch;
+};
+
+// merges bounds_of over every node, min and max are exact so the parallel result matches the serial one
+template <typename Fn>
+AABB merge_bounds(std::span<const TreeNodeData> nodes, Fn bounds_of)
+{
+	const AABB empty{vec3{1e30f}, vec3{-1e30f}};
+
+	if(nodes.size() < parallel_partition_threshold)
 	{
-		if(ctx.nodes[0].is_node())
-			ctx.alloc.get(ctx.nodes[0].as_node()).parent = BVH4Node::invalid_index;
+		AABB bounds = empty;
+		for(const TreeNodeData& n : nodes)
+			bounds = AABB::merge(bounds, bounds_of(n));
 
-		return {ctx.nodes[0], get_node_bounds(ctx.nodes[0])};
+		return bounds;
 	}
 
-	const Handle<BVH4Node> root = ctx.alloc.allocate();
-	BVH4Node& root_node = ctx.alloc.get(root);
-	root_node.invalidate();
-	root_node.dirty = (ctx.force_dirty_level > 0u);
+	return job::parallel_reduce(nodes, parallel_build_grain, empty, bounds_of, [](const AABB& lhs, const AABB& rhs)
+	{
+		return AABB::merge(lhs, rhs);
+	});
+}
 
-	auto node_data = std::make_unique_for_overwrite<TreeNodeData[]>(ctx.nodes.size());
+AABB range_bounds(std::span<const TreeNodeData> nodes)
+{
+	ZoneScoped;
 
-	AABB root_bounds{vec3{1e30f}, vec3{-1e30f}};
+	return merge_bounds(nodes, [](const TreeNodeData& n)
+	{
+		return n.bounds;
+	});
+}
 
+// one pass over the nodes fills the bins of all three axes
+SAHBins bin_nodes(std::span<const TreeNodeData> nodes, const std::array<SAHSplit, 3>& splits)
+{
+	SAHBins bins;
+	for(const TreeNodeData& n : nodes)
 	{
+		for(uint32_t axis = 0; axis < 3; axis++)
+		{
+			const uint32_t b = splits[axis].bin_of(n.bounds);
+			bins.bounds[axis][b] = AABB::merge(bins.bounds[axis][b], n.bounds);
+			bins.counts[axis][b]++;
+		}
+	}
 
-	ZoneScopedN("collect_nodes");
-	for(uint32_t i = 0; i < ctx.nodes.size(); i++)
+	return bins;
+}
+
+// binned SAH over the centroid bounds, the split is the bin boundary with the lowest area * count on both sides.
+// Large ranges are binned per chunk on all job threads and the chunk bins merged in order
+std::optional<SAHSplit> find_sah_split(std::span<const TreeNodeData> nodes)
+{
+	ZoneScoped;
+
+	const AABB centroid_bounds = merge_bounds(nodes, [](const TreeNodeData& n)
 	{
-		const AABB rbounds = get_node_bounds(ctx.nodes[i]);
-		node_data[i].handle = ctx.nodes[i];
-		node_data[i].bounds = rbounds;
-		root_bounds = AABB::merge(root_bounds, rbounds);
+		const vec3 c = n.bounds.get_center();
+		return AABB{c, c};
+	});
+
+	// flat axes bin everything into the first bin and are skipped below
+	std::array<SAHSplit, 3> splits;
+	for(uint32_t axis = 0; axis < 3; axis++)
+	{
+		const float extent = centroid_bounds.maxs[axis] - centroid_bounds.mins[axis];
+		splits[axis] = SAHSplit{axis, 0, centroid_bounds.mins[axis], extent > 0.0f ? sah_bin_count / extent : 0.0f};
 	}
 
+	SAHBins bins;
+	if(nodes.size() < parallel_partition_threshold)
+		bins = bin_nodes(nodes, splits);
+	else
+	{
+		const std::size_t chunks = (nodes.size() + parallel_build_grain - 1) / parallel_build_grain;
+		bins = job::parallel_reduce(std::views::iota(0zu, chunks), 1zu, SAHBins{}, [nodes, &splits](std::size_t c)
+		{
+			const std::size_t first = c * parallel_build_grain;
+			return bin_nodes(nodes.subspan(first, std::min(parallel_build_grain, nodes.size() - first)), splits);
+		},
+		[](SAHBins lhs, const SAHBins& rhs)
+		{
+			for(uint32_t axis = 0; axis < 3; axis++)
+			{
+				for(uint32_t b = 0; b < sah_bin_count; b++)
+				{
+					lhs.bounds[axis][b] = AABB::merge(lhs.bounds[axis][b], rhs.bounds[axis][b]);
+					lhs.counts[axis][b] += rhs.counts[axis][b];
+				}
+			}
+
+			return lhs;
+		});
 	}
 
-	auto b_stack = std::make_unique_for_overwrite<TreeBuildRange[]>(128);
-	b_stack[0] = {BVH4NodeID{root}, root_bounds, 0, static_cast<uint32_t>(ctx.nodes.size()), 0};
-	uint32_t b_stack_top = 0;
+	std::optional<SAHSplit> best;
+	float best_cost = std::numeric_limits<float>::infinity();
 
-	// might be inefficient since we merge AABBs both in the node containing the body and its parents
-	
-	auto spatial_partition_quad = [&node_data](TreeBuildRange& r)
+	for(uint32_t axis = 0; axis < 3; axis++)
 	{
-		ZoneScoped;
-		auto spatial_partition_split = [&node_data](TreeBuildRange& range, bool increment_level = true)
-		{
-			ZoneScoped;
-			AABB hlb{vec3{1e30f}, vec3{-1e30f}};
-			AABB hrb = hlb;
+		if(splits[axis].scale == 0.0f)
+			continue;
 
-			if(!range.count)
-				return std::make_pair(TreeBuildRange{{}, hlb, range.first, 0, 0}, TreeBuildRange{{}, hrb, range.first, 0, 0});
+		const std::array<AABB, sah_bin_count>& bin_bounds = bins.bounds[axis];
+		const std::array<uint32_t, sah_bin_count>& bin_counts = bins.counts[axis];
 
+		// sweep from the right so the left side can be accumulated while scanning the split candidates
+		std::array<float, sah_bin_count> right_cost{};
+		AABB right_bounds = bin_bounds[sah_bin_count - 1];
+		uint32_t right_count = bin_counts[sah_bin_count - 1];
+		for(uint32_t b = sah_bin_count - 1; b > 0; b--)
+		{
+			right_cost[b] = right_count ? right_bounds.area() * static_cast<float>(right_count) : 0.0f;
+			right_bounds = AABB::merge(right_bounds, bin_bounds[b - 1]);
+			right_count += bin_counts[b - 1];
+		}
+
+		AABB left_bounds = bin_bounds[0];
+		uint32_t left_count = bin_counts[0];
+		for(uint32_t b = 1; b < sah_bin_count; b++)
+		{
+			const float cost = (left_count ? left_bounds.area() * static_cast<float>(left_count) : 0.0f) + right_cost[b];
+			if(left_count && left_count < nodes.size() && cost < best_cost)
 			{
+				best_cost = cost;
+				best = splits[axis];
+				best->bin = b;
+			}
 
-			ZoneScopedN("range_bounds");
-			for(uint32_t i = range.first; i < range.first + range.count; i++)
-				range.bounds = AABB::merge(range.bounds, node_data[i].bounds);
+			left_bounds = AABB::merge(left_bounds, bin_bounds[b]);
+			left_count += bin_counts[b];
+		}
+	}
 
-			}
+	return best;
+}
 
-			uint32_t axis = 0;
-			const vec3 len = range.bounds.maxs - range.bounds.mins;
-			if(len.y > len.x)
-				axis = 1;
-			if(len.z > len.y && len.z > len.x)
-				axis = 2;
+// large ranges are partitioned stably through scratch, so the order never depends on how the chunks were scheduled
+template <typename Pred>
+uint32_t partition_range(std::span<TreeNodeData> nodes, std::span<TreeNodeData> scratch, Pred pred)
+{
+	ZoneScoped;
 
-			const float plane = 0.5f * (range.bounds.mins + range.bounds.maxs)[axis];
+	if(nodes.size() < parallel_partition_threshold)
+		return static_cast<uint32_t>(std::partition(nodes.begin(), nodes.end(), pred) - nodes.begin());
 
-			TreeNodeData* part_begin;
+	const std::size_t chunks = (nodes.size() + parallel_build_grain - 1) / parallel_build_grain;
+	auto chunk = [nodes](std::span<TreeNodeData> data, std::size_t c)
+	{
+		const std::size_t first = c * parallel_build_grain;
+		return data.subspan(first, std::min(parallel_build_grain, nodes.size() - first));
+	};
 
-			{
-			ZoneScopedN("partition");
+	std::vector<uint32_t> left_offsets(chunks + 1, 0u);
+	job::parallel_for(std::views::iota(0zu, chunks), 1zu, [&](std::size_t c)
+	{
+		left_offsets[c + 1] = static_cast<uint32_t>(std::ranges::count_if(chunk(nodes, c), pred));
+	});
+
+	for(std::size_t c = 0; c < chunks; c++)
+		left_offsets[c + 1] += left_offsets[c];
 
-			part_begin = std::partition(node_data.get() + range.first, node_data.get() + range.first + range.count, [axis, plane](const TreeNodeData& in)
+	const uint32_t left_count = left_offsets[chunks];
+	job::parallel_for(std::views::iota(0zu, chunks), 1zu, [&](std::size_t c)
+	{
+		uint32_t left = left_offsets[c];
+		uint32_t right = left_count + static_cast<uint32_t>(c * parallel_build_grain) - left_offsets[c];
+		for(const TreeNodeData& n : chunk(nodes, c))
+		{
+			if(pred(n))
+				scratch[left++] = n;
+			else
+				scratch[right++] = n;
+		}
+	});
+
+	job::parallel_for(std::views::iota(0zu, chunks), 1zu, [&](std::size_t c)
+	{
+		std::ranges::copy(chunk(scratch, c), chunk(nodes, c).begin());
+	});
+
+	return left_count;
+}
+
+std::pair<TreeBuildRange, TreeBuildRange> split_range(const TreeBuildState& state, TreeBuildRange& range, bool increment_level = true)
+{
+	ZoneScoped;
+	const AABB empty{vec3{1e30f}, vec3{-1e30f}};
+
+	if(!range.count)
+		return std::make_pair(TreeBuildRange{{}, empty, range.first, 0, 0}, TreeBuildRange{{}, empty, range.first, 0, 0});
+
+	const std::span<TreeNodeData> nodes = state.node_data.subspan(range.first, range.count);
+	const std::span<TreeNodeData> scratch = state.scratch.empty() ? std::span<TreeNodeData>{} : state.scratch.subspan(range.first, range.count);
+
+	range.bounds = AABB::merge(range.bounds, range_bounds(nodes));
+
+	std::optional<uint32_t> hl_count;
+
+	{
+	ZoneScopedN("partition");
+
+	if(state.ctx.strategy == BuildStrategy::SAH)
+	{
+		if(const auto split = find_sah_split(nodes))
+		{
+			hl_count = partition_range(nodes, scratch, [&split](const TreeNodeData& in)
 			{
-				return (0.5f * (in.bounds.mins + in.bounds.maxs))[axis] < plane;
+				return split->bin_of(in.bounds) < split->bin;
 			});
+		}
+	}
 
-			}
+	if(!hl_count)
+	{
+		uint32_t axis = 0;
+		const vec3 len = range.bounds.maxs - range.bounds.mins;
+		if(len.y > len.x)
+			axis = 1;
+		if(len.z > len.y && len.z > len.x)
+			axis = 2;
 
-			uint32_t hl_count = static_cast<uint32_t>(part_begin - (node_data.get() + range.first));
+		const float plane = 0.5f * (range.bounds.mins + range.bounds.maxs)[axis];
 
-			{
-			ZoneScopedN("build_range_s0");
-			
-			for(uint32_t i = range.first; i < range.first + hl_count; i++)
-				hlb = AABB::merge(hlb, node_data[i].bounds);
-			}
+		hl_count = partition_range(nodes, scratch, [axis, plane](const TreeNodeData& in)
+		{
+			return (0.5f * (in.bounds.mins + in.bounds.maxs))[axis] < plane;
+		});
+	}
 
-			const TreeBuildRange hl{{}, hlb, range.first, hl_count, range.level + increment_level};
+	}
 
-			{
-			ZoneScopedN("build_range_s1");
+	// bodies sharing a center can't be separated spatially, split them by count so the build always makes progress
+	if(range.count > 1 && (*hl_count == 0 || *hl_count == range.count))
+		hl_count = range.count / 2;
 
-			for(uint32_t i = range.first + hl_count; i < range.first + range.count; i++)
-				hrb = AABB::merge(hrb, node_data[i].bounds);
-			}
-			
-			const TreeBuildRange hr{{}, hrb, range.first + hl_count, range.count - hl_count, range.level + increment_level};
+	const TreeBuildRange hl{{}, range_bounds(nodes.first(*hl_count)), range.first, *hl_count, range.level + increment_level};
+	const TreeBuildRange hr{{}, range_bounds(nodes.subspan(*hl_count)), range.first + *hl_count, range.count - *hl_count, range.level + increment_level};
 
-			return std::make_pair(hl, hr);
-		};
+	return std::make_pair(hl, hr);
+}
 
-		auto [hl, hr] = spatial_partition_split(r);
+// might be inefficient since we merge AABBs both in the node containing the body and its parents
+std::array<TreeBuildRange, 4> split_range_quad(const TreeBuildState& state, TreeBuildRange& r)
+{
+	ZoneScoped;
 
-		auto [q0, q1] = spatial_partition_split(hl, false);
-		auto [q2, q3] = spatial_partition_split(hr, false);
+	auto [hl, hr] = split_range(state, r);
 
-		return std::array<TreeBuildRange, 4>{q0, q1, q2, q3};
-	};
+	auto [q0, q1] = split_range(state, hl, false);
+	auto [q2, q3] = split_range(state, hr, false);
 
-	{
-	ZoneScopedN("build_tree_stackwalk");
+	return std::array<TreeBuildRange, 4>{q0, q1, q2, q3};
+}
+
+// builds the subtree below range.node, large child ranges are collected and built in parallel once the walk is done.
+// Every subtree only touches its own slice of node_data so the resulting tree is the same for any thread count
+void build_subtree(const TreeBuildState& state, const TreeBuildRange& range)
+{
+	ZoneScoped;
+	TreeBuildContext& ctx = state.ctx;
+
+	auto b_stack = std::make_unique_for_overwrite<TreeBuildRange[]>(128);
+	b_stack[0] = range;
+	uint32_t b_stack_top = 0;
+
+	std::vector<TreeBuildRange> subtrees;
 
 	for(;;)
 	{
@@ -229,9 +418,9 @@ TreeBuildResult build_tree(TreeBuildContext&& ctx)
 		{
 			for(uint32_t i = r.first; i < r.first + r.count; i++)
 			{
-				const BVH4NodeID cid = node_data[i].handle;
+				const BVH4NodeID cid = state.node_data[i].handle;
 				node.children[i - r.first] = cid;
-				node.set_child_bounds(i - r.first, node_data[i].bounds);
+				node.set_child_bounds(i - r.first, state.node_data[i].bounds);
 				if(cid.is_body())
 					ctx.rr.get(cid.as_body()).userdata = (static_cast<uint64_t>(r.node) << 32) | (i - r.first);
 				else
@@ -240,7 +429,7 @@ TreeBuildResult build_tree(TreeBuildContext&& ctx)
 		}
 		else
 		{
-			auto quads = spatial_partition_quad(r);
+			auto quads = split_range_quad(state, r);
 
 			for(uint32_t i = 0; i < 4; i++)
 			{
@@ -248,7 +437,7 @@ TreeBuildResult build_tree(TreeBuildContext&& ctx)
 				{
 					if(quads[i].count == 1)
 					{
-						const BVH4NodeID cid = node_data[quads[i].first].handle;
+						const BVH4NodeID cid = state.node_data[quads[i].first].handle;
 						node.children[i] = cid;
 						node.set_child_bounds(i, quads[i].bounds);
 						if(cid.is_body())
@@ -265,7 +454,11 @@ TreeBuildResult build_tree(TreeBuildContext&& ctx)
 						qn.dirty = ctx.force_dirty_level > quads[i].level;
 						node.children[i] = quads[i].node;
 						node.set_child_bounds(i, quads[i].bounds);
-						b_stack[b_stack_top++] = quads[i];
+
+						if(quads[i].count >= parallel_subtree_threshold)
+							subtrees.push_back(quads[i]);
+						else
+							b_stack[b_stack_top++] = quads[i];
 					}
 				}
 			}
@@ -276,7 +469,76 @@ TreeBuildResult build_tree(TreeBuildContext&& ctx)
 
 		b_stack_top--;
 	}
+
+	job::parallel_for(subtrees, 1zu, [&state](const TreeBuildRange& subtree)
+	{
+		build_subtree(state, subtree);
+	});
+}
+
+TreeBuildResult build_tree(TreeBuildContext&& ctx)
+{
+	ZoneScoped;
+	assert(!ctx.nodes.empty());
+
+	auto get_node_bounds = [&ctx](BVH4NodeID id) -> AABB
+	{
+		ZoneScoped;
+		if(id.is_body())
+			return ctx.rr.read_body(id.as_body()).fat_bounds;
 	
+		const BVH4Node& n = ctx.alloc.get(id.as_node());
+		AABB bnd = n.get_child_bounds(0);
+		for(uint32_t c = 1; c < 4; c++)
+			bnd = AABB::merge(bnd, n.get_child_bounds(c));
+
+		return bnd;
+	};
+
+	if(ctx.nodes.size() == 1)
+	{
+		if(ctx.nodes[0].is_node())
+			ctx.alloc.get(ctx.nodes[0].as_node()).parent = BVH4Node::invalid_index;
+
+		return {ctx.nodes[0], get_node_bounds(ctx.nodes[0])};
+	}
+
+	const Handle<BVH4Node> root = ctx.alloc.allocate();
+	BVH4Node& root_node = ctx.alloc.get(root);
+	root_node.invalidate();
+	root_node.dirty = (ctx.force_dirty_level > 0u);
+
+	auto node_data = std::make_unique_for_overwrite<TreeNodeData[]>(ctx.nodes.size());
+
+	// only ranges above parallel_partition_threshold partition through scratch
+	std::unique_ptr<TreeNodeData[]> scratch;
+	if(ctx.nodes.size() >= parallel_partition_threshold)
+		scratch = std::make_unique_for_overwrite<TreeNodeData[]>(ctx.nodes.size());
+
+	AABB root_bounds;
+
+	{
+
+	ZoneScopedN("collect_nodes");
+	root_bounds = job::parallel_reduce(std::views::iota(0zu, ctx.nodes.size()), parallel_build_grain, AABB{vec3{1e30f}, vec3{-1e30f}}, [&](std::size_t i)
+	{
+		const AABB rbounds = get_node_bounds(ctx.nodes[i]);
+		node_data[i].handle = ctx.nodes[i];
+		node_data[i].bounds = rbounds;
+		return rbounds;
+	},
+	[](const AABB& lhs, const AABB& rhs)
+	{
+		return AABB::merge(lhs, rhs);
+	});
+
+	}
+
+	const TreeBuildState state{ctx, {node_data.get(), ctx.nodes.size()}, {scratch.get(), scratch ? ctx.nodes.size() : 0zu}};
+
+	{
+	ZoneScopedN("build_tree_stackwalk");
+	build_subtree(state, {BVH4NodeID{root}, root_bounds, 0, static_cast<uint32_t>(ctx.nodes.size()), 0});
 	}
 
 	return {BVH4NodeID{root}, root_bounds};
@@ -292,7 +554,7 @@ void propagate_dirty_flag(ObjectPool<BVH4Node>& alloc, Handle<BVH4Node> node)
 		if(idx == BVH4Node::invalid_index)
 			return;
 
-		BVH4Node& n = alloc.get(node);
+		BVH4Node& n = alloc.get(Handle<BVH4Node>{idx});
 		if(n.dirty)
 			break;
 
@@ -340,6 +602,142 @@ void propagate_node_bounds(ObjectPool<BVH4Node>& alloc, Handle<BVH4Node> node, c
 	}
 }
 
+// filled by the queries when passed in, counts accumulate over calls
+export struct TreeQueryStats
+{
+	uint64_t nodes_visited{0};
+};
+
+// one unit of the pair traversal, lhs == rhs tests a subtree against itself
+struct TreePairTask
+{
+	BVH4NodeID lhs;
+	BVH4NodeID rhs;
+	AABB lhs_bounds;
+	AABB rhs_bounds;
+};
+
+// pushes the child tasks of task and emits the pair once both sides are bodies.
+// Bounds come from the parent slots, so leaves are tested with the bounds cached in the tree.
+// Returns the number of nodes read
+template <typename Push>
+uint32_t expand_pair_task(ObjectPool<BVH4Node>& alloc, const TreePairTask& task, Push&& push, std::vector<RigidbodyPair>& pairs)
+{
+	if(task.lhs == task.rhs)
+	{
+		if(task.lhs.is_body())
+			return 0;
+
+		const BVH4Node& node = alloc.get(task.lhs.as_node());
+		std::array<BVH4NodeID, 4> children;
+		std::array<AABB, 4> bounds;
+		for(uint32_t i = 0; i < 4; i++)
+		{
+			children[i] = BVH4NodeID{node.children[i]};
+			bounds[i] = node.get_child_bounds(i);
+		}
+
+		for(uint32_t i = 0; i < 4; i++)
+		{
+			if(children[i] == BVH4Node::invalid_index)
+				continue;
+
+			push(TreePairTask{children[i], children[i], bounds[i], bounds[i]});
+
+			for(uint32_t j = i + 1; j < 4; j++)
+			{
+				if(children[j] != BVH4Node::invalid_index && AABB::check_intersect(bounds[i], bounds[j]))
+					push(TreePairTask{children[i], children[j], bounds[i], bounds[j]});
+			}
+		}
+
+		return 1;
+	}
+
+	if(task.lhs.is_body() && task.rhs.is_body())
+	{
+		const Handle<Rigidbody> r0 = task.lhs.as_body();
+		const Handle<Rigidbody> r1 = task.rhs.as_body();
+		pairs.push_back(r0 < r1 ? RigidbodyPair{r0, r1} : RigidbodyPair{r1, r0});
+		return 0;
+	}
+
+	// descend the node side, or the larger one when both are nodes
+	const bool descend_lhs = task.lhs.is_node() && (task.rhs.is_body() || task.lhs_bounds.area() >= task.rhs_bounds.area());
+	const BVH4NodeID parent = descend_lhs ? task.lhs : task.rhs;
+	const AABB& other_bounds = descend_lhs ? task.rhs_bounds : task.lhs_bounds;
+
+	const BVH4Node& node = alloc.get(parent.as_node());
+	const uvec4 hits = aabb_test_aabb_simd4(other_bounds, node.extract_bounds_simd4());
+
+	for(uint32_t i = 0; i < 4; i++)
+	{
+		const BVH4NodeID child{node.children[i]};
+		if(!hits[i] || child == BVH4Node::invalid_index)
+			continue;
+
+		if(descend_lhs)
+			push(TreePairTask{child, task.rhs, node.get_child_bounds(i), task.rhs_bounds});
+		else
+			push(TreePairTask{task.lhs, child, task.lhs_bounds, node.get_child_bounds(i)});
+	}
+
+	return 1;
+}
+
+// the top levels are expanded into independent tasks that are traversed in parallel, the result is sorted so it
+// does not depend on scheduling
+void collect_tree_pairs(ObjectPool<BVH4Node>& alloc, const TreePairTask& root, std::vector<RigidbodyPair>& pairs, TreeQueryStats* stats)
+{
+	ZoneScoped;
+
+	constexpr uint32_t expand_levels = 2;
+
+	const std::size_t first_pair = pairs.size();
+	uint64_t nodes_visited = 0;
+	std::vector<TreePairTask> tasks{root};
+	for(uint32_t level = 0; level < expand_levels; level++)
+	{
+		std::vector<TreePairTask> next;
+		for(const TreePairTask& task : tasks)
+		{
+			nodes_visited += expand_pair_task(alloc, task, [&next](const TreePairTask& t)
+			{
+				next.push_back(t);
+			}, pairs);
+		}
+
+		tasks = std::move(next);
+	}
+
+	std::vector<std::vector<RigidbodyPair>> task_pairs(tasks.size());
+	std::vector<uint64_t> task_visits(tasks.size(), 0u);
+	job::parallel_for(std::views::iota(0zu, tasks.size()), 1zu, [&](std::size_t i)
+	{
+		std::vector<TreePairTask> stack{tasks[i]};
+		while(!stack.empty())
+		{
+			const TreePairTask task = stack.back();
+			stack.pop_back();
+
+			task_visits[i] += expand_pair_task(alloc, task, [&stack](const TreePairTask& t)
+			{
+				stack.push_back(t);
+			}, task_pairs[i]);
+		}
+	});
+
+	for(const auto& p : task_pairs)
+		pairs.insert(pairs.end(), p.begin(), p.end());
+
+	if(stats)
+		stats->nodes_visited += std::accumulate(task_visits.begin(), task_visits.end(), nodes_visited);
+
+	const auto found = pairs.begin() + static_cast<std::ptrdiff_t>(first_pair);
+	std::sort(found, pairs.end());
+	pairs.erase(std::unique(found, pairs.end()), pairs.end());
+}
+
 export struct Raycast
 {
 	vec3 origin;
@@ -380,11 +778,17 @@ public:
 		allocator->get(Handle<BVH4Node>{root_nodes[0]}).invalidate();
 	}
 
+	// applies to every following insert and rebuild
+	void set_build_strategy(BuildStrategy strategy) noexcept
+	{
+		build_strategy = strategy;
+	}
+
 	void request_insert(std::span<Handle<Rigidbody>> bodies)
 	{
 		ZoneScoped;
 
-		auto [subtree_root, subtree_bounds] = build_tree({*allocator, *rigidbody_interface, {reinterpret_cast<BVH4NodeID*>(bodies.data()), bodies.size()}, 0u});
+		auto [subtree_root, subtree_bounds] = build_tree({*allocator, *rigidbody_interface, {reinterpret_cast<BVH4NodeID*>(bodies.data()), bodies.size()}, 0u, build_strategy});
 
 		dirty = true;
 
@@ -408,14 +812,32 @@ public:
 
 		for(auto body : bodies)
 		{
-			const AABB rbounds = rigidbody_interface->read_body(body).get_transformed_bounds();
-			const uint64_t data = rigidbody_interface->read_body(body).userdata;
+			// cached bounds are refreshed by update_bounds, they are not recomputed from the transform here
+			const Rigidbody& rb = rigidbody_interface->read_body(body);
+
+			const uint64_t data = rb.userdata;
 			const BVH4NodeID nid = data >> 32;
 			const uint32_t cid = data & 0x3;
 
 			assert(nid.is_node());
 
 			BVH4Node& node = allocator->get(nid.as_node());
+
+			// the leaf holds the fat bounds of the last build or refit. Bodies still inside it only matter when their
+			// fat bounds shrank, the dirty leaf is then rebuilt from the new fat bounds
+			const AABB leaf_bounds = node.get_child_bounds(cid);
+			if(leaf_bounds.contains(rb.world_bounds))
+			{
+				if(!rb.fat_bounds.contains(leaf_bounds))
+				{
+					dirty = true;
+					propagate_dirty_flag(*allocator, nid.as_node());
+				}
+
+				continue;
+			}
+
+			const AABB rbounds = rb.fat_bounds;
 			if(node.enlarge_child_bounds(cid, rbounds))
 			{
 				dirty = true;
@@ -517,7 +939,7 @@ public:
 		}
 		else
 		{
-			auto [rnode, rbounds] = build_tree({*allocator, *rigidbody_interface, {ntree_nodes.get(), ntree_top}, 5u});
+			auto [rnode, rbounds] = build_tree({*allocator, *rigidbody_interface, {ntree_nodes.get(), ntree_top}, 5u, build_strategy});
 
 			if(rnode.is_body())
 			{
@@ -559,7 +981,7 @@ public:
 		}
 	}
 
-	RaycastResult cast_ray(const Raycast& ray, Handle<Rigidbody> ignore = RigidbodyInterface::invalid_handle)
+	RaycastResult cast_ray(const Raycast& ray, Handle<Rigidbody> ignore = RigidbodyInterface::invalid_handle, TreeQueryStats* stats = nullptr)
 	{
 		ZoneScoped;
 
@@ -570,6 +992,8 @@ public:
 		};
 
 		const float inf = std::numeric_limits<float>::infinity();
+		// leaves hold the body id with the broadphase bit set whether or not the caller's handle carries it
+		const BVH4NodeID ignore_id{ignore};
 
 		std::array<RCStackEntry, 128> c_stack;
 		uint32_t c_stack_top = 0;
@@ -587,6 +1011,9 @@ public:
 			{
 				if(entry.id.is_node())
 				{
+					if(stats)
+						stats->nodes_visited++;
+
 					const BVH4Node& node = allocator->get(entry.id.as_node());
 					const SIMD4AABB bnd = node.extract_bounds_simd4();
 
@@ -614,7 +1041,7 @@ public:
 				}
 				else
 				{
-					if(entry.id.as_body() != ignore)
+					if(entry.id != ignore_id)
 					{
 
 						if(!hit || entry.t < res.t)
@@ -647,6 +1074,8 @@ public:
 			float t;
 		};
 
+		const BVH4NodeID ignore_id{ignore};
+
 		std::array<CStackEntry, 128> c_stack;
 		uint32_t c_stack_top = 0;
 		c_stack[0] = {get_current_root(), -1.0f};
@@ -697,7 +1126,7 @@ public:
 				}
 				else
 				{
-					if(entry.id != ignore)
+					if(entry.id != ignore_id)
 					{
 						if(entry.t < cur_ray_t)
 						{
@@ -715,69 +1144,22 @@ public:
 		}
 	}
 
-	void collect_colliding_pairs(std::span<Handle<Rigidbody>> bodies, std::vector<RigidbodyPair>& pairs)
+	// appends every overlapping pair of bodies in the tree exactly once, sorted and with r0 < r1
+	void collect_colliding_pairs(std::vector<RigidbodyPair>& pairs, TreeQueryStats* stats = nullptr)
 	{
-		std::array<BVH4NodeID, 128> c_stack;
-		uint32_t c_stack_top;
-
-		for(auto body : bodies)
-		{
-			const AABB bnd1 = rigidbody_interface->read_body(body).get_transformed_bounds();
-			c_stack_top = 0;
-			c_stack[0] = get_current_root();
-
-			for(;;)
-			{
-				const BVH4NodeID entry = c_stack[c_stack_top];
-
-				if(entry.is_body())
-				{
-					if(entry != body)
-					{
-						const AABB bnd2 = rigidbody_interface->read_body(entry.as_body()).get_transformed_bounds();
-						if(AABB::check_intersect(bnd1, bnd2))
-						{
-							pairs.push_back({body, entry.as_body()});
-						}
-					}
-
-				}
-				else
-				{
-					const BVH4Node& node = allocator->get(entry.as_node());
-					const SIMD4AABB bnd = node.extract_bounds_simd4();
-					uvec4 children;
-					memcpy(&children[0], &node.children[0], 16);
-					const uvec4 box_t = aabb_test_aabb_simd4(bnd1, bnd);
-
-					struct CStackEntry
-					{
-						BVH4NodeID id;
-						uint32_t test;
-					};
-
-					std::array<CStackEntry, 4> tmp_c_stack;
-					for(uint32_t i = 0; i < 4; i++)
-						tmp_c_stack[i] = {children[i], box_t[i]};
-					
-					std::sort(std::begin(tmp_c_stack), std::end(tmp_c_stack), [](const CStackEntry& lhs, const CStackEntry& rhs)
-					{
-						return lhs.test > rhs.test;
-					});
+		ZoneScoped;
 
-					for(uint32_t i = 0; i < 4; i++)
-					{
-						if(tmp_c_stack[i].test && tmp_c_stack[i].id != BVH4Node::invalid_index)
-							c_stack[c_stack_top++] = tmp_c_stack[i].id;
-					}
-				}
+		const BVH4NodeID root{get_current_root()};
+		collect_tree_pairs(*allocator, {root, root, {}, {}}, pairs, stats);
+	}
 
-				if(c_stack_top == 0)
-					break;
+	// same as above for pairs with one body in each tree, both trees have to share the node allocator
+	void collect_colliding_pairs(BVH4Tree& other, std::vector<RigidbodyPair>& pairs, TreeQueryStats* stats = nullptr)
+	{
+		ZoneScoped;
+		assert(allocator == other.allocator);
 
-				c_stack_top--;
-			}
-		}
+		collect_tree_pairs(*allocator, {BVH4NodeID{get_current_root()}, BVH4NodeID{other.get_current_root()}, get_root_bounds(), other.get_root_bounds()}, pairs, stats);
 	}
 private:
 	bool insert_subtree(BVH4NodeID node, AABB& bounds)
@@ -853,11 +1235,22 @@ private:
 		return Handle<BVH4Node>{root_nodes[active_root]};
 	}
 
+	AABB get_root_bounds()
+	{
+		const BVH4Node& root = allocator->get(get_current_root());
+		AABB bounds = root.get_child_bounds(0);
+		for(uint32_t c = 1; c < 4; c++)
+			bounds = AABB::merge(bounds, root.get_child_bounds(c));
+
+		return bounds;
+	}
+
 	std::array<std::atomic<uint32_t>, 2> root_nodes;
 	std::atomic<uint32_t> active_root{0u};
 	std::atomic<uint32_t> root_switch_target{BVH4Node::invalid_index};
 
 	bool dirty{false};
+	BuildStrategy build_strategy{BuildStrategy::Midpoint};
 	uint32_t tree_bodies{0u};
 	std::vector<Handle<BVH4Node>> discard_nodes;
 };
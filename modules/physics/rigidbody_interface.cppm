@@ -1,3 +1,7 @@
+module;
+
+#include <cassert>
+
 export module lumina.physics:rigidbody_interface;
 
 import lumina.core;
@@ -32,6 +36,15 @@ struct Rigidbody
 {
 	constexpr static std::uint32_t broadphase_node_bit = (1u << 30);
 	constexpr static std::uint32_t handle_mask = 0x3FFFFFFF;
+	// below the broadphase bit handles hold the slot index and the low bits of the slot generation
+	constexpr static std::uint32_t index_bits = 20;
+	constexpr static std::uint32_t index_mask = (1u << index_bits) - 1u;
+	constexpr static std::uint32_t generation_mask = handle_mask >> index_bits;
+	// fat bounds are grown by this margin and cover the distance travelled over the next fat_bounds_lookahead_steps steps
+	constexpr static float fat_bounds_margin = 0.05f;
+	constexpr static float fat_bounds_lookahead_steps = 2.0f;
+	// fat bounds are refitted once their area grows past this multiple of a fresh fit, e.g. after a fast body slowed down
+	constexpr static float fat_bounds_shrink_ratio = 4.0f;
 	
 	Transform transform;
 	
@@ -50,6 +63,30 @@ struct Rigidbody
 	BodyType body_type;
 	MotionType motion_type;
 	std::uint64_t userdata;
+	// broadphase layer the body was inserted into, owned by the broadphase like userdata
+	std::uint32_t broadphase_layer{0u};
+
+	// refreshed once per step through update_cached_bounds, bodies moved outside of a step have to refresh them
+	// before they are passed to signal_body_updates
+	AABB world_bounds;
+	AABB fat_bounds;
+
+	// returns true when the fat bounds were recomputed because the body left them or they became much larger than
+	// the current sweep, dt is the length of one step
+	bool update_cached_bounds(float dt)
+	{
+		world_bounds = get_transformed_bounds();
+
+		const vec3 sweep = velocity * (dt * fat_bounds_lookahead_steps);
+		const AABB fitted{vec3::min(world_bounds.mins, world_bounds.mins + sweep) - vec3{fat_bounds_margin},
+			vec3::max(world_bounds.maxs, world_bounds.maxs + sweep) + vec3{fat_bounds_margin}};
+
+		if(fat_bounds.contains(world_bounds) && fat_bounds.area() <= fitted.area() * fat_bounds_shrink_ratio)
+			return false;
+
+		fat_bounds = fitted;
+		return true;
+	}
 
 	[[nodiscard]] constexpr AABB get_transformed_bounds() const
 	{
@@ -109,12 +146,14 @@ class RigidbodyInterface
 {
 public:
 	constexpr static Handle<Rigidbody> invalid_handle = Handle<Rigidbody>{RigidbodyAllocator::invalid_object};
-	constexpr static std::uint32_t capacity = 1024u;
+	// the allocator grows on demand, capacity only bounds the reserved address space
+	constexpr static std::uint32_t capacity = Rigidbody::index_mask + 1u;
+	constexpr static std::uint32_t initial_capacity = 1024u;
 	constexpr static std::size_t mutex_slots = 32;
 
 	RigidbodyInterface() : allocator{"rigidbody_allocator"}
 	{
-		allocator.init(capacity, capacity);
+		allocator.init(capacity, initial_capacity);
 	}
 
 	Handle<Rigidbody> create_rigidbody(const RigidbodyDescription& desc)
@@ -141,31 +180,57 @@ public:
 
 		rb.inv_inertia_tensor_local = mat3::inverse(inertia_tensor);
 
-		return Handle<Rigidbody>{alloc | Rigidbody::broadphase_node_bit};
+		rb.fat_bounds = AABB{vec3{1e30f}, vec3{-1e30f}};
+		rb.update_cached_bounds(0.0f);
+
+		const std::uint32_t generation = allocator.generation(alloc) & Rigidbody::generation_mask;
+		return Handle<Rigidbody>{alloc | (generation << Rigidbody::index_bits) | Rigidbody::broadphase_node_bit};
+	}
+
+	// call once per step after integration, bodies that left their fat bounds are appended to moved so only
+	// those have to be passed to BroadphaseInterface::signal_body_updates
+	void update_bounds(std::span<Handle<Rigidbody>> bodies, float dt, std::vector<Handle<Rigidbody>>& moved)
+	{
+		for(auto body : bodies)
+		{
+			if(get(body).update_cached_bounds(dt))
+				moved.push_back(body);
+		}
 	}
 
 	void destroy_bodies(std::span<Handle<Rigidbody>> bodies)
 	{
 		for(auto& body : bodies)
 		{
-			const std::uint32_t index = body & Rigidbody::handle_mask;
+			const std::uint32_t index = body & Rigidbody::index_mask;
 			std::unique_lock<std::shared_mutex> lock{body_locks[index % mutex_slots]};
+			assert(is_valid(body) && "rigidbody handle refers to a destroyed body");
 			allocator.deallocate(Handle<Rigidbody>{index});
 		}
 	}
 
+	// false once the body was destroyed, also after its slot has been reused until the generation bits wrap around
+	[[nodiscard]] bool is_valid(Handle<Rigidbody> handle) const noexcept
+	{
+		const Handle<Rigidbody> index{handle & Rigidbody::index_mask};
+		return allocator.is_live(index)
+			&& (allocator.generation(index) & Rigidbody::generation_mask) == ((handle & Rigidbody::handle_mask) >> Rigidbody::index_bits);
+	}
+
 	Rigidbody& get(Handle<Rigidbody> handle)
 	{
-		const std::uint32_t index = handle & Rigidbody::handle_mask;
+		const std::uint32_t index = handle & Rigidbody::index_mask;
 		std::unique_lock<std::shared_mutex> lock{body_locks[index % mutex_slots]};
+		assert(is_valid(handle) && "rigidbody handle refers to a destroyed body");
 
 		return allocator.get(Handle<Rigidbody>{index});
 	}
 
 	const Rigidbody& read_body(Handle<Rigidbody> handle) 
 	{
-		const std::uint32_t index = handle & Rigidbody::handle_mask;
-		std::shared_lock<std::shared_mutex> lock{body_locks[index & mutex_slots]};
+		const std::uint32_t index = handle & Rigidbody::index_mask;
+		std::shared_lock<std::shared_mutex> lock{body_locks[index % mutex_slots]};
+		assert(is_valid(handle) && "rigidbody handle refers to a destroyed body");
 
 		return allocator.get(Handle<Rigidbody>{index});
 	}
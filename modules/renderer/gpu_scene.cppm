@@ -48,6 +48,15 @@ struct ObjectData
 	uint32_t bucket_lod_count;
 };
 
+// the parts of a Mesh that ObjectData is packed from
+struct ObjectMesh
+{
+	vec4 sphere;
+	uint32_t lod_count;
+	uint32_t lod0_offset;
+	bool in_gpumem;
+};
+
 export struct RenderObject
 {
 	Handle<Mesh> mesh;
@@ -407,14 +416,28 @@ public:
 			ZoneScopedN("copy_gpu_objects");
 			auto cmd = device.request_command_buffer(vulkan::Queue::Graphics, "gpu_scene_ready_objects");
 			device.start_perf_event("gpu_scene_ready_objects", cmd);
-			for(auto& [handle, processed]: dirty_objects)
+			assert(dirty_objects.size() * sizeof(ObjectData) <= streambuf_size);
+			std::byte* staging = streambuf->map<std::byte>();
+
+			// get_mesh locks the mesh table, which the resource manager can grow while uploads finish,
+			// so mesh data is copied out serially and the parallel pack only reads objects and this copy
+			dirty_meshes.clear();
+			dirty_meshes.reserve(dirty_objects.size());
+			for(const auto& [handle, processed] : dirty_objects)
 			{
-				auto& object = get_object(handle);
-				auto& t = object.transform;
+				const auto& mesh = resource_manager.get_mesh(get_object(handle).mesh);
+				dirty_meshes.push_back({mesh.sphere, mesh.lod_count, mesh.lod0_offset, mesh.in_gpumem});
+			}
+
+			job::parallel_for(std::views::iota(0zu, dirty_objects.size()), object_pack_grain, [this, staging](std::size_t i)
+			{
+				auto& [handle, processed] = dirty_objects[i];
+				const auto& object = get_object(handle);
+				const auto& t = object.transform;
 
-				const auto& mesh = resource_manager.get_mesh(object.mesh);
+				const ObjectMesh& mesh = dirty_meshes[i];
 				if(!mesh.in_gpumem)
-					continue;
+					return;
 			
 				processed = true;
 				auto tm = object.transform.as_matrix();
@@ -428,16 +451,27 @@ public:
 					mesh.lod0_offset,
 					packed_bucket_lcount
 				};
-				memcpy(streambuf->map<std::byte>() + streambuf_head, &data, sizeof(ObjectData));
-				vk::BufferCopy region
-				{
-					.srcOffset = streambuf_head,
+				memcpy(staging + i * sizeof(ObjectData), &data, sizeof(ObjectData));
+			});
+
+			std::vector<vk::BufferCopy> regions;
+			regions.reserve(dirty_objects.size());
+			for(std::size_t i = 0; i < dirty_objects.size(); i++)
+			{
+				const auto& [handle, processed] = dirty_objects[i];
+				if(!processed)
+					continue;
+
+				regions.push_back
+				({
+					.srcOffset = i * sizeof(ObjectData),
 					.dstOffset = (handle - 1) * sizeof(ObjectData),
 					.size = sizeof(ObjectData)
-				};
-				cmd.vk_object().copyBuffer(streambuf->handle, object_buffer->handle, 1, &region);
-				streambuf_head += sizeof(ObjectData);
+				});
 			}
+
+			if(!regions.empty())
+				cmd.vk_object().copyBuffer(streambuf->handle, object_buffer->handle, static_cast<uint32_t>(regions.size()), regions.data());
 			
 			cmd.pipeline_barrier
 			({
@@ -1225,6 +1259,7 @@ private:
 	ResourceManager& resource_manager;
 
 	constexpr static uint32_t streambuf_size = 64 * 1024 * 1024;
+	constexpr static std::size_t object_pack_grain = 256;
 	constexpr static uint32_t initial_object_capacity = 16384u;
 
 	vulkan::BufferHandle streambuf;
@@ -1234,6 +1269,8 @@ private:
 	uint32_t gpu_object_head = 0;
 	std::vector<RenderObject> render_objects;
 	std::vector<std::pair<Handle<RenderObject>, bool>> dirty_objects;
+	// mesh data of dirty_objects by index, filled at the start of ready_objects
+	std::vector<ObjectMesh> dirty_meshes;
 
 	std::vector<RenderView> views;
 	std::unordered_map<Handle<MaterialTemplate>, MaterialBucketFilter> mtl_bucket_filters;
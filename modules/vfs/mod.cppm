@@ -299,6 +299,39 @@ ScopedFileHandle open(const path& p, access_rw_t rw_tag)
 	return {open_unscoped(p, rw_tag)};
 }
 
+// opens the file from a background job so the calling job thread is not held up by the open/mmap syscalls,
+// the awaiting coroutine is resumed on a normal priority job afterwards. The handle is unscoped and must be closed by the caller
+job::task<open_return_type> open_async(path p, access_readonly_t ro_tag)
+{
+	co_await job::schedule_on(job::Priority::Background);
+	auto result = open_unscoped(p, ro_tag);
+	co_await job::schedule_on(job::Priority::Normal);
+
+	co_return result;
+}
+
+// copies up to out.size() bytes starting at offset from a background job, so the page faults of a cold mapping are
+// taken there instead of on the awaiting job thread. Returns the number of bytes copied, fewer at the end of the file
+job::task<std::size_t> read_async(Handle<File> h, std::size_t offset, std::span<std::byte> out)
+{
+	co_await job::schedule_on(job::Priority::Background);
+
+	std::size_t copied = 0;
+	{
+	std::shared_lock<std::shared_mutex> r_lock{vfs_context->lock};
+	const File& f = vfs_context->open_files.at(h);
+	if(offset < f.size)
+	{
+		copied = std::min(out.size(), f.size - offset);
+		std::memcpy(out.data(), static_cast<const std::byte*>(f.mapped) + offset, copied);
+	}
+	}
+
+	co_await job::schedule_on(job::Priority::Normal);
+
+	co_return copied;
+}
+
 template <typename T>
 const T* map(Handle<File> h, access_readonly_t)
 {
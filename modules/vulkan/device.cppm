@@ -136,6 +136,9 @@ public:
 	vk::Semaphore wsi_signal_present();
 	
 	bool wait_timeline(Queue queue, uint64_t value);
+	// resolves immediately if the value was already reached, otherwise polls from background jobs until it is
+	// and resumes the awaiting coroutine on a normal priority job
+	job::task<bool> wait_timeline_async(Queue queue, uint64_t value);
 
 	void wait_idle();
 
@@ -731,6 +731,42 @@ bool Device::wait_timeline(Queue queue, uint64_t val)
 	return true;
 }
 
+job::task<bool> Device::wait_timeline_async(Queue queue, uint64_t val)
+{
+	const vk::Semaphore semaphore = queues[static_cast<size_t>(queue)].semaphore;
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::nanoseconds{sem_wait_timeout};
+
+	// polls the counter and reschedules between polls, so no job thread is ever blocked on the gpu
+	bool polled = false;
+	bool signaled = false;
+	for(;;)
+	{
+		uint64_t current = 0;
+		if(handle.getSemaphoreCounterValue(semaphore, &current) != vk::Result::eSuccess)
+			break;
+
+		if(current >= val)
+		{
+			signaled = true;
+			break;
+		}
+
+		if(std::chrono::steady_clock::now() >= deadline)
+		{
+			log::error("wait_timeline_async: timed out waiting for signal {:#x}, current is {:#x}", val, current);
+			break;
+		}
+
+		co_await job::schedule_on(job::Priority::Background);
+		polled = true;
+	}
+
+	if(polled)
+		co_await job::schedule_on(job::Priority::Normal);
+
+	co_return signaled;
+}
+
 void Device::destroy_resources(Queue queue, uint64_t timeline)
 {
 	ZoneScoped;
@@ -0,0 +1,102 @@
+import std;
+import lumina.core;
+
+using namespace lumina;
+using namespace std::chrono_literals;
+
+// background jobs are queued before the critical ones while every worker is busy. Once the workers are released
+// none of them may start a critical job after it started a background job, whichever order they were queued in
+constexpr int rounds = 20;
+constexpr uint32_t background_jobs = 32;
+constexpr uint32_t critical_jobs = 64;
+
+struct JobStart
+{
+	uint32_t thread{~0u};
+	uint32_t sequence{0u};
+};
+
+bool run(uint32_t concurrency, uint32_t io_threads)
+{
+	job::init(concurrency, io_threads);
+
+	bool passed = true;
+	for(int round = 0; round < rounds && passed; round++)
+	{
+		std::atomic<uint32_t> blocked{0u};
+		std::atomic<bool> release{false};
+		std::vector<job::job_handle> blockers;
+		for(uint32_t i = 1; i < concurrency; i++)
+		{
+			blockers.push_back(job::schedule([&blocked, &release]
+			{
+				blocked.fetch_add(1u);
+				while(!release.load())
+					std::this_thread::yield();
+			}, job::Priority::Critical));
+		}
+
+		while(blocked.load() != concurrency - 1)
+			std::this_thread::yield();
+
+		std::atomic<uint32_t> sequence{0u};
+		std::vector<JobStart> background_starts(background_jobs);
+		std::vector<JobStart> critical_starts(critical_jobs);
+		auto record = [&sequence](JobStart& start)
+		{
+			start = {job::get_thread_id(), sequence.fetch_add(1u)};
+		};
+
+		std::vector<job::job_handle> background;
+		for(JobStart& start : background_starts)
+		{
+			background.push_back(job::schedule([&record, &start]
+			{
+				record(start);
+				std::this_thread::sleep_for(200us);
+			}, job::Priority::Background));
+		}
+
+		std::vector<job::job_handle> critical;
+		for(JobStart& start : critical_starts)
+		{
+			critical.push_back(job::schedule([&record, &start]
+			{
+				record(start);
+				std::this_thread::sleep_for(50us);
+			}, job::Priority::Critical));
+		}
+
+		release = true;
+		job::wait(blockers);
+		job::wait(critical);
+		job::wait(background);
+
+		for(const JobStart& c : critical_starts)
+		{
+			for(const JobStart& b : background_starts)
+			{
+				if(c.thread == b.thread && c.sequence > b.sequence)
+				{
+					std::println("thread {} started a critical job after a background job in round {}", c.thread, round);
+					passed = false;
+				}
+			}
+		}
+	}
+
+	job::shutdown();
+
+	std::println("{} threads, {} io threads: {}", concurrency, io_threads, passed ? "ok" : "FAILED");
+	return passed;
+}
+
+int main()
+{
+	bool passed = true;
+	passed &= run(4, 0);
+	passed &= run(2, 0);
+	passed &= run(4, 2);
+
+	return passed ? 0 : 1;
+}
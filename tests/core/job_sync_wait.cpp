@@ -0,0 +1,60 @@
+import std;
+import lumina.core;
+
+using namespace lumina;
+
+job::task<std::vector<int>> make_values()
+{
+	co_await job::schedule_on(job::Priority::Normal);
+	co_return std::vector<int>{1, 2, 3};
+}
+
+job::task<int> throw_after_resume()
+{
+	co_await job::schedule_on(job::Priority::Normal);
+	throw std::runtime_error("thrown on a worker");
+	co_return 0;
+}
+
+job::task<void> throw_inline()
+{
+	throw std::logic_error("thrown before the first suspension");
+	co_return;
+}
+
+template <typename T>
+bool rethrows(job::task<T> t)
+{
+	try
+	{
+		job::sync_wait(std::move(t));
+	}
+	catch(const std::exception& e)
+	{
+		std::println("rethrown: {}", e.what());
+		return true;
+	}
+
+	return false;
+}
+
+int main()
+{
+	job::init(4);
+
+	bool passed = true;
+
+	const auto values = job::sync_wait(make_values());
+	if(values.size() != 3)
+	{
+		std::println("sync_wait returned {} values, expected 3", values.size());
+		passed = false;
+	}
+
+	passed &= rethrows(throw_after_resume());
+	passed &= rethrows(throw_inline());
+
+	job::shutdown();
+
+	return passed ? 0 : 1;
+}
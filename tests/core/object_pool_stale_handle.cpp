@@ -0,0 +1,64 @@
+import std;
+import lumina.core;
+
+using namespace lumina;
+
+struct Object
+{
+	std::array<std::uint64_t, 4> payload;
+};
+
+int main()
+{
+	job::init(2);
+
+	bool passed = true;
+	auto check = [&passed](bool condition, std::string_view what)
+	{
+		if(!condition)
+		{
+			std::println("failed: {}", what);
+			passed = false;
+		}
+	};
+
+	static ObjectPool<Object> pool{"stale_handle_test"};
+	pool.init(1u << 16);
+
+	// a freed slot is handed out again right away, the old handle must not match the new object
+	const auto first = pool.allocate_generational();
+	pool.deallocate(first);
+	const auto second = pool.allocate_generational();
+	check(generation_layout<std::uint32_t>::index(first) == generation_layout<std::uint32_t>::index(second), "slot was not reused");
+	check(!pool.is_valid(first), "handle to a reused slot is still valid");
+	check(pool.is_valid(second), "fresh handle is not valid");
+
+	const auto wide = pool.allocate_generational<GenerationalHandle64<Object>>();
+	pool.deallocate(wide);
+	check(!pool.is_valid(wide), "64 bit handle to a freed slot is still valid");
+
+	// handles from chunks that were released and committed again stay stale as well
+	std::vector<GenerationalHandle<Object>> handles;
+	for(int i = 0; i < 10000; i++)
+		handles.push_back(pool.allocate_generational());
+
+	const auto released = handles[100];
+	for(auto handle : handles)
+		pool.deallocate(handle);
+
+	pool.deallocate(second);
+	pool.trim();
+
+	handles.clear();
+	for(int i = 0; i < 10000; i++)
+		handles.push_back(pool.allocate_generational());
+
+	check(!pool.is_valid(released), "handle from a released chunk is valid again");
+
+	for(auto handle : handles)
+		pool.deallocate(handle);
+
+	job::shutdown();
+
+	return passed ? 0 : 1;
+}
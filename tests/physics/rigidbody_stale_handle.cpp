@@ -0,0 +1,42 @@
+import std;
+import lumina.core;
+import lumina.physics;
+
+using namespace lumina;
+using namespace lumina::physics;
+
+int main()
+{
+	job::init(2);
+
+	bool passed = true;
+	auto check = [&passed](bool condition, std::string_view what)
+	{
+		if(!condition)
+		{
+			std::println("failed: {}", what);
+			passed = false;
+		}
+	};
+
+	SphereShapeDescription sphere;
+	sphere.radius = 0.5f;
+	const RefCounted<CShape> shape = SphereShape::create(sphere);
+
+	RigidbodyInterface bodies;
+
+	Handle<Rigidbody> first = bodies.create_rigidbody({Transform{}, shape});
+	check(bodies.is_valid(first), "fresh body handle is not valid");
+
+	bodies.destroy_bodies(std::span{&first, 1});
+	const Handle<Rigidbody> second = bodies.create_rigidbody({Transform{}, shape});
+
+	check((first & Rigidbody::index_mask) == (second & Rigidbody::index_mask), "slot was not reused");
+	check(!bodies.is_valid(first), "handle to a destroyed body is valid after its slot was reused");
+	check(bodies.is_valid(second), "handle to the new body is not valid");
+	check((second & Rigidbody::broadphase_node_bit) != 0u, "body handle lost its broadphase bit");
+
+	job::shutdown();
+
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,250 @@
+import std;
+import lumina.core;
+import lumina.physics;
+
+using namespace lumina;
+using namespace lumina::physics;
+
+template <typename Fn>
+double time_ms(Fn&& fn)
+{
+	const auto start = std::chrono::steady_clock::now();
+	fn();
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::vector<uint32_t> thread_counts()
+{
+	std::vector<uint32_t> counts;
+	const uint32_t hw = std::max(std::thread::hardware_concurrency(), 1u);
+	for(uint32_t n = 1; n < hw; n *= 2)
+		counts.push_back(n);
+
+	counts.push_back(hw);
+	return counts;
+}
+
+constexpr uint32_t scene_bodies = 20'000;
+constexpr float scene_extent = 200.0f;
+
+struct Scene
+{
+	RigidbodyInterface bodies;
+	std::vector<RefCounted<CShape>> shapes;
+	std::vector<Handle<Rigidbody>> handles;
+};
+
+// spheres of a few sizes, either spread evenly over the scene or piled into a few dense clusters
+void fill_scene(Scene& scene, bool clustered)
+{
+	for(float radius : {0.25f, 0.5f, 1.0f})
+	{
+		SphereShapeDescription desc;
+		desc.radius = radius;
+		scene.shapes.push_back(SphereShape::create(desc));
+	}
+
+	std::mt19937 rng{42};
+	std::uniform_real_distribution<float> uniform{0.0f, scene_extent};
+	std::normal_distribution<float> spread{0.0f, 3.0f};
+
+	constexpr uint32_t cluster_count = 16;
+	std::vector<vec3> clusters;
+	for(uint32_t i = 0; i < cluster_count; i++)
+		clusters.push_back(vec3{uniform(rng), uniform(rng), uniform(rng)});
+
+	for(uint32_t i = 0; i < scene_bodies; i++)
+	{
+		vec3 position{uniform(rng), uniform(rng), uniform(rng)};
+		if(clustered)
+			position = clusters[i % cluster_count] + vec3{spread(rng), spread(rng), spread(rng)};
+
+		Transform transform;
+		transform.translate(position);
+		scene.handles.push_back(scene.bodies.create_rigidbody({transform, scene.shapes[i % scene.shapes.size()]}));
+	}
+}
+
+// build time and nodes visited per query for both build strategies on the same scene
+void bench_strategies(bool clustered)
+{
+	constexpr uint32_t ray_count = 10'000;
+
+	Scene scene;
+	fill_scene(scene, clustered);
+
+	std::mt19937 rng{7};
+	std::uniform_real_distribution<float> uniform{0.0f, scene_extent};
+	std::vector<Raycast> rays;
+	for(uint32_t i = 0; i < ray_count; i++)
+	{
+		const vec3 from{uniform(rng), uniform(rng), uniform(rng)};
+		const vec3 to{uniform(rng), uniform(rng), uniform(rng)};
+		rays.push_back({from, to - from});
+	}
+
+	std::println("\n{} scene, {} bodies", clustered ? "clustered" : "random", scene_bodies);
+	std::println("{:>10} {:>10} {:>10} {:>10} {:>10} {:>10} {:>12}", "strategy", "build ms", "ray ms", "nodes/ray", "pairs", "pairs ms", "pair nodes");
+
+	for(BuildStrategy strategy : {BuildStrategy::Midpoint, BuildStrategy::SAH})
+	{
+		BVH4Tree::NodeAllocator nodes{"bench_nodes"};
+		nodes.init(BroadphaseInterface::max_nodes, scene_bodies);
+
+		BVH4Tree tree;
+		tree.init(&nodes, &scene.bodies);
+		tree.set_build_strategy(strategy);
+
+		const double build_ms = time_ms([&]
+		{
+			tree.request_insert(scene.handles);
+			tree.rebuild_tree();
+			tree.switch_root();
+		});
+
+		TreeQueryStats ray_stats;
+		const double ray_ms = time_ms([&]
+		{
+			for(const Raycast& ray : rays)
+				tree.cast_ray(ray, RigidbodyInterface::invalid_handle, &ray_stats);
+		});
+
+		TreeQueryStats pair_stats;
+		std::vector<RigidbodyPair> pairs;
+		const double pairs_ms = time_ms([&]
+		{
+			tree.collect_colliding_pairs(pairs, &pair_stats);
+		});
+
+		std::println("{:>10} {:>10.2f} {:>10.2f} {:>10.1f} {:>10} {:>10.2f} {:>12}", strategy == BuildStrategy::SAH ? "sah" : "midpoint", build_ms, ray_ms,
+			static_cast<double>(ray_stats.nodes_visited) / ray_count, pairs.size(), pairs_ms, pair_stats.nodes_visited);
+	}
+}
+
+// full build of the clustered scene, best of a few runs per thread count
+void bench_build_scaling()
+{
+	constexpr int runs = 5;
+
+	Scene scene;
+	fill_scene(scene, true);
+
+	std::println("\nbuild scaling, clustered scene, {} bodies", scene_bodies);
+	std::println("{:>8} {:>12} {:>12} {:>12}", "threads", "midpoint ms", "sah ms", "sah speedup");
+
+	double single_thread_ms = 0.0;
+	for(uint32_t threads : thread_counts())
+	{
+		job::init(threads);
+
+		std::array<double, 2> best{std::numeric_limits<double>::max(), std::numeric_limits<double>::max()};
+		for(BuildStrategy strategy : {BuildStrategy::Midpoint, BuildStrategy::SAH})
+		{
+			for(int run = 0; run < runs; run++)
+			{
+				BVH4Tree::NodeAllocator nodes{"bench_nodes"};
+				nodes.init(BroadphaseInterface::max_nodes, scene_bodies);
+
+				BVH4Tree tree;
+				tree.init(&nodes, &scene.bodies);
+				tree.set_build_strategy(strategy);
+
+				double& ms = best[strategy == BuildStrategy::SAH];
+				ms = std::min(ms, time_ms([&]
+				{
+					tree.request_insert(scene.handles);
+				}));
+			}
+		}
+
+		if(threads == 1)
+			single_thread_ms = best[1];
+
+		std::println("{:>8} {:>12.2f} {:>12.2f} {:>11.2f}x", threads, best[0], best[1], single_thread_ms / best[1]);
+		job::shutdown();
+	}
+}
+
+// slowly drifting bodies, only the ones that leave their fat bounds are passed to the broadphase
+void bench_refit()
+{
+	constexpr uint32_t body_count = 5'000;
+	constexpr uint32_t steps = 600;
+	constexpr float dt = 1.0f / 60.0f;
+
+	SphereShapeDescription desc;
+	desc.radius = 0.5f;
+	const RefCounted<CShape> shape = SphereShape::create(desc);
+
+	RigidbodyInterface bodies;
+	BroadphaseInterface broadphase{bodies};
+
+	std::mt19937 rng{3};
+	std::uniform_real_distribution<float> uniform{0.0f, 100.0f};
+	std::uniform_real_distribution<float> speed{-0.5f, 0.5f};
+
+	std::vector<Handle<Rigidbody>> handles;
+	for(uint32_t i = 0; i < body_count; i++)
+	{
+		Transform transform;
+		transform.translate(vec3{uniform(rng), uniform(rng), uniform(rng)});
+		const Handle<Rigidbody> body = bodies.create_rigidbody({transform, shape});
+		bodies.get(body).velocity = vec3{speed(rng), speed(rng), speed(rng)};
+		handles.push_back(body);
+	}
+
+	broadphase.request_insert(BroadphaseLayers::Dynamic, handles);
+	broadphase.ready_update();
+	broadphase.finalize_update();
+
+	// signal_all passes every body each step like before the cached bounds, as the baseline
+	std::vector<Handle<Rigidbody>> moved;
+	auto run = [&](bool signal_all, uint64_t& refits)
+	{
+		return time_ms([&]
+		{
+			for(uint32_t step = 0; step < steps; step++)
+			{
+				for(Handle<Rigidbody> body : handles)
+				{
+					Rigidbody& rb = bodies.get(body);
+					rb.transform.translate(rb.velocity * dt);
+				}
+
+				moved.clear();
+				bodies.update_bounds(handles, dt, moved);
+				if(signal_all)
+					moved = handles;
+
+				broadphase.signal_body_updates(moved);
+				broadphase.ready_update();
+				broadphase.finalize_update();
+
+				refits += moved.size();
+			}
+		});
+	};
+
+	uint64_t all_refits = 0;
+	uint64_t fat_refits = 0;
+	const double all_ms = run(true, all_refits);
+	const double fat_ms = run(false, fat_refits);
+
+	std::println("\nrefit, {} bodies below 1m/s over {} steps", body_count, steps);
+	std::println("{:>16} {:>12} {:>10}", "signalled", "refits/step", "step ms");
+	std::println("{:>16} {:>12.1f} {:>10.3f}", "every body", static_cast<double>(all_refits) / steps, all_ms / steps);
+	std::println("{:>16} {:>12.1f} {:>10.3f}", "left fat bounds", static_cast<double>(fat_refits) / steps, fat_ms / steps);
+}
+
+int main()
+{
+	job::init();
+
+	bench_strategies(false);
+	bench_strategies(true);
+	bench_refit();
+
+	job::shutdown();
+
+	bench_build_scaling();
+}
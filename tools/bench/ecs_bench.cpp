@@ -0,0 +1,255 @@
+import std;
+import lumina.core;
+import lumina.ecs;
+
+using namespace lumina;
+
+template <typename Fn>
+double time_ms(Fn&& fn)
+{
+	const auto start = std::chrono::steady_clock::now();
+	fn();
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+struct Position
+{
+	std::array<float, 4> value;
+};
+
+struct Velocity
+{
+	std::array<float, 4> value;
+};
+
+struct Health
+{
+	float value;
+};
+
+// despawns a random half of 100k entities one by one and as a single batch
+void bench_despawn()
+{
+	constexpr std::uint32_t count = 100'000;
+
+	std::vector<ecs::entity> victims;
+	for(std::uint32_t i = 0; i < count; i++)
+		victims.emplace_back(i + 1);
+
+	std::ranges::shuffle(victims, std::mt19937{42});
+	victims.resize(count / 2);
+
+	auto fill = [](ecs::component_pool<Position>& pool)
+	{
+		for(std::uint32_t i = 0; i < count; i++)
+			pool.emplace(ecs::entity{i + 1}, Position{});
+	};
+
+	ecs::component_pool<Position> single;
+	fill(single);
+	const double single_ms = time_ms([&]
+	{
+		for(const ecs::entity ent : victims)
+			single.erase(ent);
+	});
+
+	ecs::component_pool<Position> batched;
+	fill(batched);
+	const double batched_ms = time_ms([&]{ batched.erase(std::span<const ecs::entity>{victims}); });
+
+	std::println("despawn {} of {} entities", victims.size(), count);
+	std::println("{:>24} {:>10.2f}ms", "erase per entity", single_ms);
+	std::println("{:>24} {:>10.2f}ms", "erase(span)", batched_ms);
+}
+
+// every entity has a position, half have a velocity and a quarter have health so the view has to filter
+void bench_view()
+{
+	constexpr std::uint32_t count = 1'000'000;
+
+	ecs::component_pool<Position> positions;
+	ecs::component_pool<Velocity> velocities;
+	ecs::component_pool<Health> healths;
+	for(std::uint32_t i = 0; i < count; i++)
+	{
+		const ecs::entity ent{i + 1};
+		positions.emplace(ent, Position{});
+		if(i % 2 == 0)
+			velocities.emplace(ent, Velocity{{1.0f, 1.0f, 1.0f, 0.0f}});
+		if(i % 4 == 0)
+			healths.emplace(ent, Health{1.0f});
+	}
+
+	ecs::view<ecs::component_pool<Position>, ecs::component_pool<Velocity>, ecs::component_pool<Health>> view{&positions, &velocities, &healths};
+
+	std::uint32_t visited = 0;
+	const double view_ms = time_ms([&]
+	{
+		view.for_each([&visited](Position& p, Velocity& v, Health& h)
+		{
+			for(std::size_t i = 0; i < 4; i++)
+				p.value[i] += v.value[i] * h.value;
+
+			visited++;
+		});
+	});
+
+	// the same filter through an indirect call per membership test, the cost the virtual contains used to add
+	using contains_fn = bool (*)(const void*, ecs::entity);
+	volatile contains_fn has_position = [](const void* pool, ecs::entity ent) { return static_cast<const ecs::component_pool<Position>*>(pool)->contains(ent); };
+	volatile contains_fn has_velocity = [](const void* pool, ecs::entity ent) { return static_cast<const ecs::component_pool<Velocity>*>(pool)->contains(ent); };
+
+	std::uint32_t erased_visited = 0;
+	const double erased_ms = time_ms([&]
+	{
+		for(auto&& [ent, h] : healths.pair_iterator())
+		{
+			if(!has_position(&positions, ent) || !has_velocity(&velocities, ent))
+				continue;
+
+			Position& p = positions.get(ent);
+			const Velocity& v = velocities.get(ent);
+			for(std::size_t i = 0; i < 4; i++)
+				p.value[i] += v.value[i] * h.value;
+
+			erased_visited++;
+		}
+	});
+
+	std::println("\n3 component view over {} entities, {} matches", count, visited);
+	std::println("{:>24} {:>10.2f}ms {:>8.2f}ns/match", "view::for_each", view_ms, view_ms * 1e6 / visited);
+	std::println("{:>24} {:>10.2f}ms {:>8.2f}ns/match", "type-erased contains", erased_ms, erased_ms * 1e6 / erased_visited);
+}
+
+// par_for_each over 1M entities with every thread count, for_each on one thread as the baseline
+void bench_par_for_each()
+{
+	constexpr std::uint32_t count = 1'000'000;
+
+	ecs::component_pool<Position> positions;
+	ecs::component_pool<Velocity> velocities;
+	for(std::uint32_t i = 0; i < count; i++)
+	{
+		positions.emplace(ecs::entity{i + 1}, Position{});
+		velocities.emplace(ecs::entity{i + 1}, Velocity{{1.0f, 2.0f, 3.0f, 0.0f}});
+	}
+
+	ecs::view<ecs::component_pool<Position>, ecs::component_pool<Velocity>> view{&positions, &velocities};
+	auto integrate = [](Position& p, Velocity& v)
+	{
+		for(std::size_t i = 0; i < 4; i++)
+			p.value[i] += std::sin(v.value[i]) * 0.016f;
+	};
+
+	const double serial_ms = time_ms([&]{ view.for_each(integrate); });
+
+	std::println("\npar_for_each over {} entities, for_each {:.2f}ms", count, serial_ms);
+	std::println("{:>8} {:>10} {:>8}", "threads", "ms", "speedup");
+
+	const std::uint32_t hw = std::max(std::thread::hardware_concurrency(), 1u);
+	for(std::uint32_t threads = 1; ; threads = std::min(threads * 2, hw))
+	{
+		job::init(threads);
+		const double ms = time_ms([&]{ view.par_for_each(integrate); });
+		job::shutdown();
+
+		std::println("{:>8} {:>10.2f} {:>8.2f}", threads, ms, serial_ms / ms);
+		if(threads == hw)
+			break;
+	}
+}
+
+// 100k commands recorded from job threads and applied in one flush, for both storage modes
+void bench_command_flush()
+{
+	constexpr std::uint32_t entity_count = 25'000;
+
+	job::init();
+	std::println("\nflush {} queued commands", 4 * entity_count);
+	std::println("{:>12} {:>12} {:>12} {:>14}", "storage", "record ms", "flush ms", "Mcommands/s");
+
+	for(auto [mode, name] : {std::pair{ecs::storage_mode::sparse_set, "sparse_set"}, std::pair{ecs::storage_mode::archetype, "archetype"}})
+	{
+		ecs::Realm realm{mode};
+		std::vector<ecs::entity> entities;
+		for(std::uint32_t i = 0; i < entity_count; i++)
+			entities.push_back(realm.spawn());
+
+		const double record_ms = time_ms([&]
+		{
+			job::parallel_for(entities, job::auto_grain, [&realm](ecs::entity ent)
+			{
+				ecs::CommandBuffer& commands = realm.commands();
+				commands.emplace<Position>(ent);
+				commands.emplace<Velocity>(ent);
+				commands.emplace<Health>(ent, 1.0f);
+				commands.remove<Velocity>(ent);
+			});
+		});
+
+		const double flush_ms = time_ms([&]{ realm.flush_commands(); });
+		std::println("{:>12} {:>12.2f} {:>12.2f} {:>14.2f}", name, record_ms, flush_ms, 4.0 * entity_count / flush_ms / 1000.0);
+	}
+
+	job::shutdown();
+}
+
+// Realm::get and try_get per entity in random order, try_get misses for every other entity
+void bench_get()
+{
+	constexpr std::uint32_t entity_count = 60'000;
+	constexpr int passes = 50;
+
+	ecs::Realm realm;
+	std::vector<ecs::entity> entities;
+	for(std::uint32_t i = 0; i < entity_count; i++)
+	{
+		const ecs::entity ent = realm.spawn();
+		entities.push_back(ent);
+		realm.emplace<Position>(ent);
+		if(i % 2 == 0)
+			realm.emplace<Health>(ent, 1.0f);
+	}
+
+	std::ranges::shuffle(entities, std::mt19937{7});
+
+	float sum = 0.0f;
+	const double get_ms = time_ms([&]
+	{
+		for(int pass = 0; pass < passes; pass++)
+		{
+			for(const ecs::entity ent : entities)
+				sum += realm.get<Position>(ent).value[0];
+		}
+	});
+
+	std::uint32_t hits = 0;
+	const double try_get_ms = time_ms([&]
+	{
+		for(int pass = 0; pass < passes; pass++)
+		{
+			for(const ecs::entity ent : entities)
+			{
+				if(const Health* health = realm.try_get<Health>(ent))
+				{
+					sum += health->value;
+					hits++;
+				}
+			}
+		}
+	});
+
+	const double calls = static_cast<double>(passes) * entity_count;
+	std::println("\nrealm lookups, {} entities in random order (checksum {})", entity_count, sum);
+	std::println("{:>24} {:>8.2f}ns/call", "get<T>", get_ms * 1e6 / calls);
+	std::println("{:>24} {:>8.2f}ns/call ({:.0f}% hits)", "try_get<T>", try_get_ms * 1e6 / calls, 100.0 * hits / calls);
+}
+
+int main()
+{
+	bench_despawn();
+	bench_view();
+	bench_par_for_each();
+	bench_command_flush();
+	bench_get();
+}
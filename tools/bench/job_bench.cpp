@@ -0,0 +1,118 @@
+#include <version>
+
+import std;
+import lumina.core;
+
+using namespace lumina;
+
+template <typename Fn>
+double time_ms(Fn&& fn)
+{
+	const auto start = std::chrono::steady_clock::now();
+	fn();
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::vector<uint32_t> thread_counts()
+{
+	std::vector<uint32_t> counts;
+	const uint32_t hw = std::max(std::thread::hardware_concurrency(), 1u);
+	for(uint32_t n = 1; n < hw; n *= 2)
+		counts.push_back(n);
+
+	counts.push_back(hw);
+	return counts;
+}
+
+// one million empty jobs, scheduled from the main thread and fanned out from jobs so every deque has an owner pushing
+void bench_empty_jobs()
+{
+	constexpr uint32_t job_count = 1'000'000;
+	constexpr uint32_t producers = 64;
+
+	std::println("empty jobs ({} per run)", job_count);
+	std::println("{:>8} {:>14} {:>14}", "threads", "main Mjobs/s", "fanout Mjobs/s");
+
+	for(uint32_t threads : thread_counts())
+	{
+		job::init(threads);
+
+		const double main_ms = time_ms([]
+		{
+			for(uint32_t i = 0; i < job_count; i++)
+				job::schedule([]{});
+
+			job::wait_for_work();
+		});
+
+		const double fanout_ms = time_ms([]
+		{
+			for(uint32_t p = 0; p < producers; p++)
+			{
+				job::schedule([]
+				{
+					for(uint32_t i = 0; i < job_count / producers; i++)
+						job::schedule([]{});
+				});
+			}
+
+			job::wait_for_work();
+		});
+
+		std::println("{:>8} {:>14.2f} {:>14.2f}", threads, job_count / main_ms / 1000.0, job_count / fanout_ms / 1000.0);
+		job::shutdown();
+	}
+}
+
+// parallel_for against a plain loop and the standard parallel algorithms on the same per-element work
+void bench_parallel_for()
+{
+	constexpr size_t count = 1zu << 24;
+
+	std::vector<float> values(count);
+	auto kernel = [](float& v)
+	{
+		v = std::sqrt(std::fabs(std::sin(v) * 3.0f + v));
+	};
+	auto reset = [&values]
+	{
+		std::iota(values.begin(), values.end(), 0.0f);
+	};
+
+	std::println("\nparallel_for over {} floats", count);
+
+	reset();
+	const double serial_ms = time_ms([&]{ std::ranges::for_each(values, kernel); });
+	std::println("{:>24} {:>10.2f}ms", "serial", serial_ms);
+
+#if defined(__cpp_lib_execution) && defined(__cpp_lib_parallel_algorithm)
+	reset();
+	const double std_par_ms = time_ms([&]{ std::for_each(std::execution::par, values.begin(), values.end(), kernel); });
+	std::println("{:>24} {:>10.2f}ms", "std::execution::par", std_par_ms);
+#else
+	std::println("{:>24} {:>12}", "std::execution::par", "unavailable");
+#endif
+
+	job::init();
+	for(size_t grain : {job::auto_grain, 1024zu, 16384zu})
+	{
+		reset();
+		const double ms = time_ms([&]{ job::parallel_for(values, grain, kernel); });
+		std::println("{:>18} {:>5} {:>10.2f}ms", "parallel_for grain", grain == job::auto_grain ? "auto" : std::to_string(grain), ms);
+	}
+
+	reset();
+	double sum = 0.0;
+	const double reduce_ms = time_ms([&]
+	{
+		sum = job::parallel_reduce(values, job::auto_grain, 0.0, [](float v){ return static_cast<double>(v); }, std::plus<double>{});
+	});
+	std::println("{:>24} {:>10.2f}ms (sum {:.0f})", "parallel_reduce", reduce_ms, sum);
+	job::shutdown();
+}
+
+int main()
+{
+	bench_empty_jobs();
+	bench_parallel_for();
+}
@@ -0,0 +1,69 @@
+import std;
+import lumina.core;
+
+using namespace lumina;
+
+template <typename Fn>
+double time_ms(Fn&& fn)
+{
+	const auto start = std::chrono::steady_clock::now();
+	fn();
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+struct Body
+{
+	std::array<float, 16> state;
+};
+
+// every job keeps a small window of live objects and churns through it, the total work is the same at every thread count
+void bench_contention(uint32_t threads)
+{
+	constexpr uint32_t total_ops = 8'000'000;
+	constexpr uint32_t window = 64;
+
+	job::init(threads);
+
+	// set up after job::init so every worker has its own cache, also when threads exceeds the hardware threads
+	ObjectPool<Body> pool{"bench_pool"};
+	pool.init(1u << 20, 1u << 16);
+
+	const uint32_t ops_per_thread = total_ops / threads;
+	const double ms = time_ms([&]
+	{
+		std::vector<job::job_handle> jobs;
+		for(uint32_t t = 0; t < threads; t++)
+		{
+			jobs.push_back(job::schedule([&pool, ops_per_thread]
+			{
+				std::array<Handle<Body>, window> live;
+				for(auto& h : live)
+					h = pool.allocate();
+
+				for(uint32_t i = 0; i < ops_per_thread; i++)
+				{
+					auto& slot = live[i % window];
+					pool.deallocate(slot);
+					slot = pool.allocate();
+				}
+
+				for(auto h : live)
+					pool.deallocate(h);
+			}));
+		}
+
+		job::wait(jobs);
+	});
+
+	std::println("{:>8} {:>12.2f} {:>14.2f}", threads, ms, 2.0 * total_ops / ms / 1000.0);
+	job::shutdown();
+}
+
+int main()
+{
+	std::println("object pool allocate + deallocate, {} operations per run", 16'000'000);
+	std::println("{:>8} {:>12} {:>14}", "threads", "ms", "Mops/s");
+
+	for(uint32_t threads : {1u, 4u, 16u, 64u})
+		bench_contention(threads);
+}